@@ -0,0 +1,158 @@
+// DistributedSorter class.  Sorts data that is spread over the ranks
+// of a multi-process job, with a Transport to move it between them.
+// It is the sample sort of SorterThreaded one level up: each rank
+// samples its data and rank 0 gathers the samples, picks size() - 1
+// splitters from them and broadcasts them.  Each sample stands for
+// the number of values on its rank divided by the number of samples
+// the rank sent, so ranks with more data count for more.  Every rank then uses
+// SorterThreaded::partition() to group its data into one bucket per
+// rank, the buckets are exchanged all-to-all, and each rank sorts
+// what it received with SorterThreaded::sort().
+//
+// After sort() every value on rank r is less than or equal to every
+// value on rank r + 1, and each rank's data is sorted.  The number of
+// values on each rank changes.  The type must be trivially copyable
+// since it is sent as bytes.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_distributed_sorter_hpp
+#define st_distributed_sorter_hpp
+
+#include <set>
+#include <vector>
+#include <algorithm>
+#include <type_traits>
+#include <utility>
+#include <stdint.h>
+#include "transport.hpp"
+#include "sorter_threaded.hpp"
+
+template <class type>
+class DistributedSorter {
+  public:
+    // oversample is the number of samples each rank contributes per
+    // splitter.  More samples give more even buckets.  Values below 1
+    // are raised to 1.
+    DistributedSorter(Transport& transport, int oversample=32);
+    void sort(std::vector<type>& data);
+    // The sorter used on each rank, e.g. to set its backend.
+    SorterThreaded<type>& local();
+  private:
+    Transport& transport_;
+    int oversample_;
+    SorterThreaded<type> local_;
+};
+
+template <class type>
+DistributedSorter<type>::DistributedSorter(Transport& transport, int oversample) :
+  transport_(transport),
+  oversample_(oversample < 1 ? 1 : oversample) {
+  static_assert(std::is_trivially_copyable<type>::value,
+                "DistributedSorter sends values as bytes");
+}
+
+template <class type>
+SorterThreaded<type>& DistributedSorter<type>::local() {
+  return local_;
+}
+
+template <class type>
+void DistributedSorter<type>::sort(std::vector<type>& data) {
+  int size = transport_.size();
+  if (size == 1) {
+    local_.sort(data.begin(), data.end());
+    return;
+  }
+
+  // Take evenly spaced samples of the local data.
+  size_t numSamples = static_cast<size_t>(oversample_) * (size - 1);
+  if (numSamples > data.size()) {
+    numSamples = data.size();
+  }
+  std::vector<type> samples(numSamples);
+  for (size_t i = 0; i < numSamples; ++i) {
+    samples[i] = data[i * data.size() / numSamples];
+  }
+
+  // Rank 0 picks the splitters from all of the samples, weighted by
+  // how many values each one stands for.
+  std::vector<char> buf;
+  std::vector<uint64_t> localCount(1, data.size());
+  SorterThreadedHelper::pack<uint64_t>(localCount.begin(), localCount.end(), buf);
+  std::vector<std::vector<char> > countBufs;
+  SorterThreadedHelper::gather(transport_, 0, buf, countBufs);
+  SorterThreadedHelper::pack<type>(samples.begin(), samples.end(), buf);
+  std::vector<std::vector<char> > bufs;
+  SorterThreadedHelper::gather(transport_, 0, buf, bufs);
+  std::vector<type> splitters;
+  if (transport_.rank() == 0) {
+    std::vector<std::pair<type, double> > allSamples;
+    double totalWeight = 0;
+    for (int r = 0; r < size; ++r) {
+      SorterThreadedHelper::unpack(bufs[r], samples);
+      SorterThreadedHelper::unpack(countBufs[r], localCount);
+      if (samples.empty()) continue;
+      double weight = static_cast<double>(localCount[0]) / samples.size();
+      for (size_t i = 0; i < samples.size(); ++i) {
+        allSamples.push_back(std::pair<type, double>(samples[i], weight));
+      }
+      totalWeight += static_cast<double>(localCount[0]);
+    }
+    std::sort(allSamples.begin(), allSamples.end(),
+              [](const std::pair<type, double>& l, const std::pair<type, double>& r) {
+                return l.first < r.first;
+              });
+    // Splitter r is the first sample with more than r / size of the
+    // total weight at or below it.
+    int r = 1;
+    double cumulative = 0;
+    for (size_t i = 0; i < allSamples.size() && r < size; ++i) {
+      cumulative += allSamples[i].second;
+      while (r < size && cumulative > totalWeight * r / size) {
+        splitters.push_back(allSamples[i].first);
+        ++r;
+      }
+    }
+    while (!allSamples.empty() && r < size) {
+      splitters.push_back(allSamples.back().first);
+      ++r;
+    }
+    SorterThreadedHelper::pack<type>(splitters.begin(), splitters.end(), buf);
+  }
+  SorterThreadedHelper::broadcast(transport_, 0, buf);
+  SorterThreadedHelper::unpack(buf, splitters);
+
+  // Group the local data by destination rank.  Repeated splitters
+  // leave fewer buckets than ranks, and the last ranks get nothing.
+  std::vector<std::vector<char> > sendBufs(size);
+  if (!splitters.empty()) {
+    std::set<type> pivots(splitters.begin(), splitters.end());
+    std::vector<typename std::vector<type>::iterator> taskOffsets;
+    local_.partition(data.begin(), data.end(), pivots, taskOffsets);
+    taskOffsets.push_back(data.end());
+    for (size_t b = 0; b + 1 < taskOffsets.size(); ++b) {
+      SorterThreadedHelper::pack<type>(taskOffsets[b], taskOffsets[b + 1], sendBufs[b]);
+    }
+  }
+  else {
+    // No rank had any data to sample.
+    SorterThreadedHelper::pack<type>(data.begin(), data.end(), sendBufs[transport_.rank()]);
+  }
+  std::vector<type>().swap(data);
+
+  std::vector<std::vector<char> > recvBufs;
+  SorterThreadedHelper::allToAll(transport_, sendBufs, recvBufs);
+  sendBufs.clear();
+
+  std::vector<type> received;
+  for (int r = 0; r < size; ++r) {
+    SorterThreadedHelper::unpack(recvBufs[r], received);
+    data.insert(data.end(), received.begin(), received.end());
+    std::vector<char>().swap(recvBufs[r]);
+  }
+  local_.sort(data.begin(), data.end());
+}
+
+#endif
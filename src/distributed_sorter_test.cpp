@@ -0,0 +1,122 @@
+// Unit test for the DistributedSorter class.  Forks a four rank job
+// connected with SocketTransport.  Should be run with the environment
+// variable OMP_NUM_THREADS set to a value greater than one.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "distributed_sorter.hpp"
+#include "socket_transport.hpp"
+#include <cstdlib>
+#include <algorithm>
+#include <assert.h>
+
+using namespace SorterThreadedHelper;
+
+// Sorts data across the job and checks that it ends up in order on
+// and across the ranks with nothing lost.  If maxImbalance is not
+// zero no rank may end up with more than maxImbalance times the
+// average number of values.
+void checkSort(Transport& transport, std::vector<double>& data,
+               double maxImbalance = 0, int oversample = 32) {
+  int rank = transport.rank();
+  int size = transport.size();
+  double localSum = 0;
+  for (size_t i = 0; i < data.size(); ++i) {
+    localSum += data[i];
+  }
+  std::vector<double> before(2);
+  before[0] = data.size();
+  before[1] = localSum;
+
+  DistributedSorter<double> sorter(transport, oversample);
+  sorter.sort(data);
+  assert(std::is_sorted(data.begin(), data.end()));
+
+  // Rank 0 checks the counts, sums and the order between ranks.
+  std::vector<double> summary(before);
+  summary.push_back(data.size());
+  summary.push_back(0);
+  for (size_t i = 0; i < data.size(); ++i) {
+    summary[3] += data[i];
+  }
+  summary.push_back(data.empty() ? 0 : data.front());
+  summary.push_back(data.empty() ? 0 : data.back());
+  std::vector<char> buf;
+  pack<double>(summary.begin(), summary.end(), buf);
+  std::vector<std::vector<char> > bufs;
+  gather(transport, 0, buf, bufs);
+  if (rank == 0) {
+    double countBefore = 0, countAfter = 0, sumBefore = 0, sumAfter = 0;
+    double largest = 0;
+    bool haveLast = false;
+    double last = 0;
+    for (int r = 0; r < size; ++r) {
+      unpack(bufs[r], summary);
+      countBefore += summary[0];
+      sumBefore += summary[1];
+      countAfter += summary[2];
+      sumAfter += summary[3];
+      largest = std::max(largest, summary[2]);
+      if (summary[2] != 0) {
+        assert(!haveLast || !(summary[4] < last));
+        last = summary[5];
+        haveLast = true;
+      }
+    }
+    assert(countBefore == countAfter);
+    assert(sumBefore == sumAfter);
+    assert(maxImbalance == 0 || largest <= maxImbalance * countAfter / size);
+  }
+}
+
+int main(int argc, char **argv) {
+  int numRanks = 4;
+  SocketTransport* transport = SocketTransport::spawn(numRanks);
+  int rank = transport->rank();
+  srand(rank + 1);
+
+  // Different amounts of unique values on each rank.
+  std::vector<double> data(100000 + rank * 25000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<double>(rand());
+  }
+  checkSort(*transport, data);
+
+  // Rank 0 holds far more values than the others, from a different
+  // range, and the buckets must still come out even.
+  data.resize(rank == 0 ? 1000000 : 1000);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = rank == 0 ? static_cast<double>(rand()) : -1.0 - rand();
+  }
+  checkSort(*transport, data, 2.0);
+
+  // An oversample of 0 still takes a sample.
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<double>(rand());
+  }
+  checkSort(*transport, data, 0, 0);
+
+  // Few distinct values, so splitters repeat.
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = static_cast<double>(rand() % 3);
+  }
+  checkSort(*transport, data);
+
+  // One rank holds everything.
+  if (rank != 2) {
+    data.clear();
+  }
+  checkSort(*transport, data);
+
+  // Nobody has any data.
+  data.clear();
+  checkSort(*transport, data);
+
+  if (rank != 0) {
+    delete transport;
+    _exit(0);
+  }
+  assert(transport->join());
+  delete transport;
+}
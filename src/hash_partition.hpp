@@ -0,0 +1,224 @@
+// HashPartition is a class used to break up a vector into pieces by
+// the hash of each value rather than by pivots.  Equal values always
+// land in the same piece, but the pieces are not in any order.  It
+// has the same interface as Partition, so that SorterThreaded can use
+// either one for its partition step, and like Partition each piece is
+// stored in a std::stack.
+//
+// groupRange() then groups one piece with an open addressing hash
+// table sized for the piece up front.  The table holds indices into
+// the piece rather than copies of the values, so there is no
+// allocation per distinct value.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_hash_partition_hpp
+#define st_hash_partition_hpp
+
+#include <cstddef>
+#include <stdint.h>
+#include <stack>
+#include <vector>
+#include <functional>
+#include <iterator>
+#include <utility>
+
+namespace SorterThreadedHelper {
+  // Each thread will have a partition and the members will
+  // be single threaded functions.
+
+  template <class type, class hasher = std::hash<type> >
+  class HashPartition {
+    public:
+      HashPartition(size_t numTasks, const hasher& hash = hasher());
+      HashPartition(const HashPartition& other);
+      ~HashPartition();
+
+      // Returns the task that a value belongs in.
+      size_t task(const type& value) const;
+
+      // Pushes all of the values in a chunk onto the partition
+      // stacks.
+      void fill(typename std::vector<type>::const_iterator begin,
+                typename std::vector<type>::const_iterator end);
+
+      // Returns all of the values in the current task.
+      void popTask(typename std::vector<type>::iterator begin);
+
+      size_t numTasks() const;
+      size_t curTask();
+      size_t curSize();
+      void taskSizes(std::vector<size_t> &sizes);
+
+    private:
+      hasher hash_;
+      size_t curTask_;
+      std::vector<std::stack<type>*> partition_;
+  };
+
+  // Rearranges [begin, end) so that equal values are next to each
+  // other, in the order each value is first seen, and appends the
+  // beginning of each group to groups.
+  template <class type, class hasher>
+  void groupRange(typename std::vector<type>::iterator begin,
+                  typename std::vector<type>::iterator end,
+                  const hasher& hash,
+                  std::vector<typename std::vector<type>::iterator>& groups);
+
+  template <class type, class hasher>
+  HashPartition<type, hasher>::HashPartition(size_t numTasks, const hasher& hash) :
+    hash_(hash),
+    curTask_(0),
+    partition_(numTasks) {
+    for (size_t i = 0; i < numTasks; ++i) {
+      partition_[i] = new std::stack<type>;
+    }
+  }
+
+  template <class type, class hasher>
+  HashPartition<type, hasher>::HashPartition(const HashPartition& other) :
+    hash_(other.hash_),
+    curTask_(other.curTask_),
+    partition_(other.partition_.size()) {
+    for (size_t i = 0; i < partition_.size(); ++i) {
+      partition_[i] = new std::stack<type>(*other.partition_[i]);
+    }
+  }
+
+  template <class type, class hasher>
+  HashPartition<type, hasher>::~HashPartition() {
+    for (size_t i = 0; i < partition_.size(); ++i) {
+      delete partition_[i];
+    }
+  }
+
+  template <class type, class hasher>
+  size_t HashPartition<type, hasher>::task(const type& value) const {
+    // Hashes like std::hash of an integer are the identity, so mix
+    // the bits (Fibonacci hashing) before taking the remainder.
+    uint64_t mixed = static_cast<uint64_t>(hash_(value)) * 0x9E3779B97F4A7C15ull;
+    return static_cast<size_t>((mixed >> 32) % partition_.size());
+  }
+
+  template <class type, class hasher>
+  void HashPartition<type, hasher>::fill(typename std::vector<type>::const_iterator chunkBegin,
+                                         typename std::vector<type>::const_iterator chunkEnd) {
+    for (typename std::vector<type>::const_iterator it = chunkBegin;
+         it != chunkEnd; ++it) {
+      partition_[task(*it)]->push(*it);
+    }
+  }
+
+  template <class type, class hasher>
+  void HashPartition<type, hasher>::popTask(typename std::vector<type>::iterator begin) {
+    // Fills the input vector with all of the values stored in the
+    // current task's stack, then moves on to the next task.
+    typename std::vector<type>::iterator it(begin);
+    std::stack<type>* stack = partition_[curTask_];
+    while (!stack->empty()) {
+      *it = stack->top();
+      stack->pop();
+      ++it;
+    }
+    ++curTask_;
+    if (curTask_ == partition_.size()) {
+      curTask_ = 0;
+    }
+  }
+
+  template <class type, class hasher>
+  size_t HashPartition<type, hasher>::numTasks() const {
+    return partition_.size();
+  }
+
+  template <class type, class hasher>
+  size_t HashPartition<type, hasher>::curTask() {
+    return curTask_;
+  }
+
+  template <class type, class hasher>
+  size_t HashPartition<type, hasher>::curSize() {
+    return partition_[curTask_]->size();
+  }
+
+  // The table and the per value ids use index_type, 32 bits when
+  // the range is short enough.
+  template <class type, class hasher, class index_type>
+  void groupRangeIndexed(typename std::vector<type>::iterator begin, size_t n,
+                         const hasher& hash,
+                         std::vector<typename std::vector<type>::iterator>& groups) {
+    // At most half full, so probe sequences stay short.
+    size_t capacity = 2;
+    int shift = 63;
+    while (capacity < 2 * n) {
+      capacity <<= 1;
+      --shift;
+    }
+    const index_type empty = static_cast<index_type>(-1);
+    std::vector<index_type> slots(capacity, empty);
+    std::vector<index_type> firsts;
+    std::vector<index_type> counts;
+    std::vector<index_type> ids(n);
+    for (size_t j = 0; j < n; ++j) {
+      // HashPartition used the Fibonacci mix to pick this piece, so
+      // use a different mix (the MurmurHash3 finalizer) for the slot.
+      uint64_t h = static_cast<uint64_t>(hash(begin[j]));
+      h ^= h >> 33;
+      h *= 0xFF51AFD7ED558CCDull;
+      h ^= h >> 33;
+      size_t slot = static_cast<size_t>(h >> shift);
+      while (slots[slot] != empty && !(begin[firsts[slots[slot]]] == begin[j])) {
+        slot = (slot + 1) & (capacity - 1);
+      }
+      if (slots[slot] == empty) {
+        slots[slot] = static_cast<index_type>(firsts.size());
+        firsts.push_back(static_cast<index_type>(j));
+        counts.push_back(0);
+      }
+      ids[j] = slots[slot];
+      ++counts[ids[j]];
+    }
+    std::vector<index_type>().swap(slots);
+
+    size_t start = 0;
+    for (size_t g = 0; g < counts.size(); ++g) {
+      size_t count = counts[g];
+      counts[g] = static_cast<index_type>(start);
+      groups.push_back(begin + start);
+      start += count;
+    }
+    std::vector<type> grouped(n);
+    for (size_t j = 0; j < n; ++j) {
+      grouped[counts[ids[j]]++] = std::move(begin[j]);
+    }
+    std::move(grouped.begin(), grouped.end(), begin);
+  }
+
+  template <class type, class hasher>
+  void groupRange(typename std::vector<type>::iterator begin,
+                  typename std::vector<type>::iterator end,
+                  const hasher& hash,
+                  std::vector<typename std::vector<type>::iterator>& groups) {
+    size_t n = std::distance(begin, end);
+    if (n == 0) {
+      return;
+    }
+    if (n < (static_cast<size_t>(1) << 31)) {
+      groupRangeIndexed<type, hasher, uint32_t>(begin, n, hash, groups);
+    }
+    else {
+      groupRangeIndexed<type, hasher, size_t>(begin, n, hash, groups);
+    }
+  }
+
+  template <class type, class hasher>
+  void HashPartition<type, hasher>::taskSizes(std::vector<size_t>& sizes) {
+    sizes.resize(partition_.size());
+    for (size_t i = 0; i < partition_.size(); ++i) {
+      sizes[i] = partition_[i]->size();
+    }
+  }
+}
+
+#endif
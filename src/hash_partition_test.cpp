@@ -0,0 +1,90 @@
+// Unit test for the HashPartition class.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include <algorithm>
+#include <map>
+#include <assert.h>
+#include "hash_partition.hpp"
+
+using namespace SorterThreadedHelper;
+
+struct ConstantHash {
+  size_t operator() (int value) const {
+    return 42;
+  }
+};
+
+// Groups values with groupRange() and checks that each group holds
+// one value, every copy of it, and that no value has two groups.
+template <class hasher>
+void checkGroups(std::vector<int> values, const hasher& hash) {
+  std::map<int, size_t> expected;
+  for (size_t i = 0; i < values.size(); ++i) {
+    ++expected[values[i]];
+  }
+  std::vector<std::vector<int>::iterator> groups;
+  groupRange<int, hasher>(values.begin(), values.end(), hash, groups);
+  assert(groups.size() == expected.size());
+  assert(groups.empty() || groups[0] == values.begin());
+  for (size_t g = 0; g < groups.size(); ++g) {
+    std::vector<int>::iterator groupEnd = g != groups.size() - 1 ? groups[g+1] : values.end();
+    assert(std::count(groups[g], groupEnd, *groups[g]) == groupEnd - groups[g]);
+    assert(static_cast<size_t>(groupEnd - groups[g]) == expected[*groups[g]]);
+    expected.erase(*groups[g]);
+  }
+  assert(expected.empty());
+}
+
+int main(int argc, char **argv) {
+  int testSize = 100000;
+  std::vector<int> testVec(testSize);
+  for (int i = 0; i < testSize; ++i) {
+    testVec[i] = i % 1000;
+  }
+  random_shuffle(testVec.begin(), testVec.end());
+
+  size_t numTasks = 7;
+  HashPartition<int> part(numTasks);
+  part.fill(testVec.begin(), testVec.end());
+  assert(part.numTasks() == numTasks);
+
+  std::vector<size_t> taskSizes;
+  part.taskSizes(taskSizes);
+  size_t sumTaskSizes = 0;
+  for (size_t i = 0; i < numTasks; ++i) {
+    // 1000 values over 7 tasks should not leave any task empty.
+    assert(taskSizes[i] != 0);
+    sumTaskSizes += taskSizes[i];
+  }
+  assert(sumTaskSizes == static_cast<size_t>(testSize));
+
+  // Every value comes back in the task it hashes to.
+  HashPartition<int> copy(part);
+  std::vector<int> task(testSize);
+  for (size_t i = 0; i < numTasks; ++i) {
+    assert(copy.curTask() == i);
+    assert(copy.curSize() == taskSizes[i]);
+    copy.popTask(task.begin());
+    for (size_t j = 0; j < taskSizes[i]; ++j) {
+      assert(part.task(task[j]) == i);
+    }
+  }
+  assert(copy.curTask() == 0);
+
+  // groupRange() with every value distinct, with repeats, and with a
+  // hash that sends everything to one slot so that all lookups probe.
+  checkGroups(testVec, std::hash<int>());
+  std::vector<int> distinct(testSize);
+  for (int i = 0; i < testSize; ++i) {
+    distinct[i] = i * 7919;
+  }
+  random_shuffle(distinct.begin(), distinct.end());
+  checkGroups(distinct, std::hash<int>());
+  std::vector<int> few(distinct.begin(), distinct.begin() + 2000);
+  for (int i = 0; i < 2000; ++i) {
+    few.push_back(few[i]);
+  }
+  checkGroups(few, ConstantHash());
+}
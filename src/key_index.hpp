@@ -0,0 +1,96 @@
+// SorterThreadedHelper::KeyIndex class and permute() function used
+// by SorterThreaded::sortByKey().  A KeyIndex pairs a key with the
+// position it was read from so that only the key column has to go
+// through the partition and sort steps.  The resulting permutation
+// is then applied to each payload column in place with permute().
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_key_index_hpp
+#define st_key_index_hpp
+
+#include <cstddef>
+#include <vector>
+#include <iterator>
+#include <utility>
+#include "key_prefix.hpp"
+
+namespace SorterThreadedHelper {
+
+  template <class type>
+  struct KeyIndex {
+    KeyIndex();
+    KeyIndex(const type& k, size_t i);
+    type key;
+    size_t index;
+  };
+
+  // Keys are compared first and ties are broken with the original
+  // position.  This makes sortByKey() stable, and since no two
+  // KeyIndex values are equal there are always enough unique pivots.
+  template <class type>
+  bool operator< (const KeyIndex<type>& l, const KeyIndex<type>& r);
+
+  // Reorders a payload column in place so that position i holds the
+  // value that was at position perm[i].  The cycles of perm are
+  // followed one at a time: each value is moved once, straight to
+  // where it belongs, plus one move through a temporary per cycle.
+  // The only extra memory is one bit per position.
+  template <class iterator>
+  void permute(const std::vector<size_t>& perm, iterator payload);
+}
+
+// A KeyIndex has the prefix of its key, so sortByKey() gets the same
+// prefix comparisons as sort().  Both rules of the trait still hold
+// since ties on the key are broken by the index.
+template <class type>
+struct KeyPrefix<SorterThreadedHelper::KeyIndex<type> > {
+  static const bool enabled = KeyPrefix<type>::enabled;
+  static uint64_t get(const SorterThreadedHelper::KeyIndex<type>& value) {
+    return KeyPrefix<type>::get(value.key);
+  }
+};
+
+namespace SorterThreadedHelper {
+
+  template <class type>
+  KeyIndex<type>::KeyIndex() :
+    key(), index(0) {}
+
+  template <class type>
+  KeyIndex<type>::KeyIndex(const type& k, size_t i) :
+    key(k), index(i) {}
+
+  template <class type>
+  bool operator< (const KeyIndex<type>& l, const KeyIndex<type>& r) {
+    if (l.key < r.key) return true;
+    if (r.key < l.key) return false;
+    return l.index < r.index;
+  }
+
+  template <class iterator>
+  void permute(const std::vector<size_t>& perm, iterator payload) {
+    typedef typename std::iterator_traits<iterator>::value_type value_type;
+    size_t n = perm.size();
+    std::vector<bool> placed(n, false);
+    for (size_t start = 0; start < n; ++start) {
+      if (placed[start] || perm[start] == start) {
+        continue;
+      }
+      // Hold the first value of the cycle, pull each value along to
+      // the position before it, and drop the held value at the end.
+      value_type held(std::move(payload[start]));
+      size_t i = start;
+      while (perm[i] != start) {
+        payload[i] = std::move(payload[perm[i]]);
+        placed[i] = true;
+        i = perm[i];
+      }
+      payload[i] = std::move(held);
+      placed[i] = true;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,91 @@
+// Unit test for the SorterThreadedHelper::KeyIndex class and
+// permute() function.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "key_index.hpp"
+#include <string>
+#include <cstdlib>
+#include <algorithm>
+#include <assert.h>
+
+using namespace SorterThreadedHelper;
+
+// Counts every move and copy of a value.
+struct Counted {
+  Counted() : value(0) {}
+  Counted(int v) : value(v) {}
+  Counted(const Counted& other) : value(other.value) { ++numMoves; }
+  Counted(Counted&& other) : value(other.value) { ++numMoves; }
+  Counted& operator= (const Counted& other) { value = other.value; ++numMoves; return *this; }
+  Counted& operator= (Counted&& other) { value = other.value; ++numMoves; return *this; }
+  int value;
+  static size_t numMoves;
+};
+
+size_t Counted::numMoves = 0;
+
+int main(int argc, char **argv) {
+  KeyIndex<double> ki0(1.0, 5);
+  KeyIndex<double> ki1(2.0, 0);
+  KeyIndex<double> ki2(1.0, 6);
+
+  assert(ki0 < ki1);
+  assert(!(ki1 < ki0));
+  assert(ki0 < ki2);
+  assert(!(ki2 < ki0));
+  assert(!(ki0 < ki0));
+
+  // A KeyIndex uses the KeyPrefix of its key, if it has one.
+  assert(!KeyPrefix<KeyIndex<double> >::enabled);
+  assert((KeyPrefix<KeyIndex<std::string> >::enabled));
+  KeyIndex<std::string> ks0(std::string("apple"), 3);
+  KeyIndex<std::string> ks1(std::string("apple"), 1);
+  KeyIndex<std::string> ks2(std::string("banana"), 0);
+  assert(KeyPrefix<KeyIndex<std::string> >::get(ks0) == normalizeKey(std::string("apple")));
+  assert(KeyPrefix<KeyIndex<std::string> >::get(ks0) == KeyPrefix<KeyIndex<std::string> >::get(ks1));
+  assert(KeyPrefix<KeyIndex<std::string> >::get(ks1) < KeyPrefix<KeyIndex<std::string> >::get(ks2));
+
+  size_t testSize = 1000;
+  std::vector<size_t> perm(testSize);
+  std::vector<std::string> payload(testSize);
+  for (size_t i = 0; i < testSize; ++i) {
+    perm[i] = testSize - 1 - i;
+    payload[i] = std::string(i % 7 + 1, 'a' + i % 26);
+  }
+  std::vector<std::string> original(payload);
+
+  permute(perm, payload.begin());
+  for (size_t i = 0; i < testSize; ++i) {
+    assert(payload[i] == original[testSize - 1 - i]);
+  }
+
+  // A random permutation moves each value that is out of place once,
+  // plus one move through a temporary per cycle.
+  for (size_t i = 0; i < testSize; ++i) {
+    perm[i] = i;
+  }
+  std::random_shuffle(perm.begin(), perm.end());
+  size_t numOutOfPlace = 0;
+  size_t numCycles = 0;
+  std::vector<bool> seen(testSize, false);
+  for (size_t i = 0; i < testSize; ++i) {
+    if (perm[i] != i) ++numOutOfPlace;
+    if (seen[i] || perm[i] == i) continue;
+    ++numCycles;
+    for (size_t j = i; !seen[j]; j = perm[j]) {
+      seen[j] = true;
+    }
+  }
+  std::vector<Counted> counted(testSize);
+  for (size_t i = 0; i < testSize; ++i) {
+    counted[i].value = static_cast<int>(i);
+  }
+  Counted::numMoves = 0;
+  permute(perm, counted.begin());
+  assert(Counted::numMoves == numOutOfPlace + numCycles);
+  for (size_t i = 0; i < testSize; ++i) {
+    assert(counted[i].value == static_cast<int>(perm[i]));
+  }
+}
@@ -0,0 +1,122 @@
+// KeyPrefix trait and prefixSort() function.  For types whose
+// operator< is expensive, KeyPrefix maps each value to a 64 bit
+// unsigned prefix that preserves the order: if a < b then
+// prefix(a) <= prefix(b), and if neither a < b nor b < a then
+// prefix(a) == prefix(b).  Comparing prefixes then settles most
+// comparisons, and operator< is only needed when the prefixes are
+// equal.  Partition uses the prefixes to classify values against the
+// pivots, and the basic sort of each task uses prefixSort().
+//
+// The trait is off for any type that does not specialize it.  It is
+// on for std::string, whose prefix is its first eight bytes.  To turn
+// it on for another type specialize KeyPrefix with enabled set to
+// true and a static get() function.  Both rules above must hold:
+// Partition finds a value's task among the pivots with the same
+// prefix, so equivalent values with different prefixes can land in
+// different tasks.  The normalizeKey() functions encode integers,
+// floating point values and strings in the right order, e.g. for the
+// leading member of a struct.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_key_prefix_hpp
+#define st_key_prefix_hpp
+
+#include <cstddef>
+#include <cstring>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+
+template <class type>
+struct KeyPrefix {
+  static const bool enabled = false;
+  static uint64_t get(const type& value) {
+    return 0;
+  }
+};
+
+// Order preserving encodings.  Signed values have their sign bit
+// flipped; negative floating point values have all of their bits
+// flipped and positive ones just the sign bit.  Strings keep their
+// first eight bytes, most significant first.
+template <class integral>
+typename std::enable_if<std::is_integral<integral>::value, uint64_t>::type
+normalizeKey(integral value) {
+  if (std::is_signed<integral>::value) {
+    return static_cast<uint64_t>(static_cast<int64_t>(value)) ^ (static_cast<uint64_t>(1) << 63);
+  }
+  return static_cast<uint64_t>(value);
+}
+
+inline uint64_t normalizeKey(double value) {
+  // -0.0 and 0.0 are equivalent so they must get the same prefix.
+  if (value == 0.0) {
+    value = 0.0;
+  }
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits & (static_cast<uint64_t>(1) << 63) ? ~bits : bits ^ (static_cast<uint64_t>(1) << 63);
+}
+
+inline uint64_t normalizeKey(const std::string& value) {
+  uint64_t prefix = 0;
+  size_t length = std::min(value.size(), sizeof(prefix));
+  for (size_t i = 0; i < sizeof(prefix); ++i) {
+    prefix <<= 8;
+    if (i < length) {
+      prefix |= static_cast<unsigned char>(value[i]);
+    }
+  }
+  return prefix;
+}
+
+template <>
+struct KeyPrefix<std::string> {
+  static const bool enabled = true;
+  static uint64_t get(const std::string& value) {
+    return normalizeKey(value);
+  }
+};
+
+namespace SorterThreadedHelper {
+  // Orders (prefix, value) pairs by prefix, then by value.
+  template <class type>
+  struct PrefixLess {
+    bool operator() (const std::pair<uint64_t, type>& l,
+                     const std::pair<uint64_t, type>& r) const {
+      if (l.first != r.first) return l.first < r.first;
+      return l.second < r.second;
+    }
+  };
+
+  // Sorts a range with std::sort(), comparing cached prefixes before
+  // falling back to operator<.  The values are moved out next to
+  // their prefixes and moved back once sorted.  Without a KeyPrefix
+  // this is just std::sort().
+  template <class type>
+  void prefixSort(typename std::vector<type>::iterator begin,
+                  typename std::vector<type>::iterator end) {
+    if (!KeyPrefix<type>::enabled) {
+      std::sort(begin, end);
+      return;
+    }
+    std::vector<std::pair<uint64_t, type> > keyed;
+    keyed.reserve(std::distance(begin, end));
+    for (typename std::vector<type>::iterator it = begin; it != end; ++it) {
+      uint64_t prefix = KeyPrefix<type>::get(*it);
+      keyed.push_back(std::pair<uint64_t, type>(prefix, std::move(*it)));
+    }
+    std::sort(keyed.begin(), keyed.end(), PrefixLess<type>());
+    typename std::vector<type>::iterator out = begin;
+    for (size_t i = 0; i < keyed.size(); ++i, ++out) {
+      *out = std::move(keyed[i].second);
+    }
+  }
+}
+
+#endif
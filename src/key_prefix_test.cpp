@@ -0,0 +1,120 @@
+// Unit test for the KeyPrefix trait and prefixSort().
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <assert.h>
+#include "key_prefix.hpp"
+
+using namespace SorterThreadedHelper;
+
+// A record compared by a string key, counting calls to operator<.
+struct Record {
+  std::string key;
+  int value;
+  static size_t numCompares;
+};
+
+size_t Record::numCompares = 0;
+
+bool operator< (const Record& l, const Record& r) {
+  ++Record::numCompares;
+  return l.key < r.key;
+}
+
+template <>
+struct KeyPrefix<Record> {
+  static const bool enabled = true;
+  static uint64_t get(const Record& value) {
+    return normalizeKey(value.key);
+  }
+};
+
+// Checks that the prefixes of a sorted vector never decrease.
+template <class type>
+void checkOrder(const std::vector<type>& sorted) {
+  for (size_t i = 1; i < sorted.size(); ++i) {
+    assert(normalizeKey(sorted[i-1]) <= normalizeKey(sorted[i]));
+  }
+}
+
+std::string randomString(size_t length) {
+  std::string result(length, 'a');
+  for (size_t i = 0; i < length; ++i) {
+    result[i] = static_cast<char>('a' + rand() % 4);
+  }
+  return result;
+}
+
+int main(int argc, char **argv) {
+  int testSize = 10000;
+
+  std::vector<int64_t> ints;
+  std::vector<double> doubles;
+  for (int i = 0; i < testSize; ++i) {
+    ints.push_back(static_cast<int64_t>(rand()) - RAND_MAX / 2);
+    doubles.push_back((rand() - RAND_MAX / 2) * 1.0e-3);
+  }
+  ints.push_back(INT64_MIN);
+  ints.push_back(INT64_MAX);
+  doubles.push_back(-1.0e300);
+  doubles.push_back(1.0e300);
+  doubles.push_back(0.0);
+  std::sort(ints.begin(), ints.end());
+  std::sort(doubles.begin(), doubles.end());
+  checkOrder(ints);
+  checkOrder(doubles);
+  assert(normalizeKey(-0.0) == normalizeKey(0.0));
+  assert(normalizeKey(-1) < normalizeKey(0));
+  assert(normalizeKey(-1LL) < normalizeKey(1LL));
+  assert(normalizeKey(static_cast<short>(-5)) < normalizeKey(static_cast<short>(5)));
+  assert(normalizeKey(5ULL) < normalizeKey(6ULL));
+  assert(normalizeKey(static_cast<unsigned char>(200)) == 200);
+  assert(normalizeKey(-3) == normalizeKey(-3LL));
+
+  // Strings that share their first eight bytes share a prefix, and
+  // a shorter string sorts before any string it begins.
+  std::vector<std::string> strings;
+  for (int i = 0; i < testSize; ++i) {
+    strings.push_back(randomString(rand() % 12));
+  }
+  std::vector<std::string> expected(strings);
+  std::sort(expected.begin(), expected.end());
+  checkOrder(expected);
+  assert(normalizeKey(std::string("abcdefgh1")) == normalizeKey(std::string("abcdefgh2")));
+  assert(normalizeKey(std::string("ab")) < normalizeKey(std::string("abc")));
+
+  prefixSort<std::string>(strings.begin(), strings.end());
+  assert(strings == expected);
+
+  // Without a KeyPrefix prefixSort() is std::sort().
+  std::random_shuffle(ints.begin(), ints.end());
+  std::vector<int64_t> sortedInts(ints);
+  std::sort(sortedInts.begin(), sortedInts.end());
+  prefixSort<int64_t>(ints.begin(), ints.end());
+  assert(ints == sortedInts);
+
+  // Keys that mostly differ in their first eight bytes need few full
+  // comparisons.
+  std::vector<Record> records(testSize);
+  for (int i = 0; i < testSize; ++i) {
+    records[i].key = randomString(16);
+    records[i].value = i;
+  }
+  std::vector<Record> plain(records);
+  Record::numCompares = 0;
+  std::sort(plain.begin(), plain.end());
+  size_t plainCompares = Record::numCompares;
+
+  Record::numCompares = 0;
+  prefixSort<Record>(records.begin(), records.end());
+  size_t prefixCompares = Record::numCompares;
+  assert(prefixCompares * 10 < plainCompares);
+  for (int i = 0; i < testSize; ++i) {
+    assert(records[i].key == plain[i].key);
+  }
+}
@@ -0,0 +1,125 @@
+// Merge path functions used by SorterThreaded::insert() to merge a
+// sorted batch into a sorted vector in parallel.
+//
+// mergePathSplit() finds where a diagonal of the merge grid crosses
+// the merge path: how many values of each input come before a given
+// position in the output.  Splitting the output at evenly spaced
+// diagonals gives each thread an equal share of the merge.
+//
+// mergeInPlace() merges a sorted batch, read in place through const
+// iterators, into the space at the end of a vector that already holds
+// a sorted range.  Each thread merges its share
+// from the back, which is safe in place because no value of the
+// vector moves down.  The only values a thread can overwrite before
+// another thread reads them are at the front of each share, and those
+// are copied out first.  That copy is at most the batch size per
+// thread, however long the vector is.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_merge_path_hpp
+#define st_merge_path_hpp
+
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+#include "thread_backend.hpp"
+
+namespace SorterThreadedHelper {
+  // Returns the number of values from a in the first diag values of
+  // the stable merge of a and b.  Values of a come before equal
+  // values of b.
+  template <class type>
+  size_t mergePathSplit(typename std::vector<type>::const_iterator a, size_t aLen,
+                        typename std::vector<type>::const_iterator b, size_t bLen,
+                        size_t diag);
+
+  // sorted[0, numSorted) and [batchBegin, batchEnd) are sorted and
+  // sorted.size() is numSorted plus the batch size.  Afterwards
+  // sorted holds the stable merge of the two.  The batch must not be
+  // part of sorted.
+  template <class type>
+  void mergeInPlace(std::vector<type>& sorted, size_t numSorted,
+                    typename std::vector<type>::const_iterator batchBegin,
+                    typename std::vector<type>::const_iterator batchEnd,
+                    ThreadBackend& backend, int numThreads);
+
+  template <class type>
+  size_t mergePathSplit(typename std::vector<type>::const_iterator a, size_t aLen,
+                        typename std::vector<type>::const_iterator b, size_t bLen,
+                        size_t diag) {
+    size_t lo = diag > bLen ? diag - bLen : 0;
+    size_t hi = diag < aLen ? diag : aLen;
+    while (lo < hi) {
+      size_t mid = lo + (hi - lo) / 2;
+      if (b[diag - mid - 1] < a[mid]) {
+        hi = mid;
+      }
+      else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+
+  template <class type>
+  void mergeInPlace(std::vector<type>& sorted, size_t numSorted,
+                    typename std::vector<type>::const_iterator batch,
+                    typename std::vector<type>::const_iterator batchEnd,
+                    ThreadBackend& backend, int numThreads) {
+    size_t numBatch = std::distance(batch, batchEnd);
+    size_t total = numSorted + numBatch;
+    if (numBatch == 0) {
+      return;
+    }
+    size_t numParts = numThreads;
+    if (numParts > total) {
+      numParts = total;
+    }
+
+    // Part k writes output [diags[k], diags[k+1]) from sorted values
+    // [splits[k], splits[k+1]) and the rest from the batch.
+    std::vector<size_t> diags(numParts + 1);
+    std::vector<size_t> splits(numParts + 1);
+    for (size_t k = 0; k <= numParts; ++k) {
+      diags[k] = total * k / numParts;
+    }
+    typename std::vector<type>::const_iterator sortedBegin = sorted.begin();
+    backend.parallelFor(static_cast<int>(numParts + 1), numThreads, [&](int k) {
+      splits[k] = mergePathSplit<type>(sortedBegin, numSorted, batch, numBatch, diags[k]);
+    });
+
+    // The first sorted values of each part sit below its output and
+    // may be overwritten by the part before it.
+    std::vector<std::vector<type> > heads(numParts);
+    backend.parallelFor(static_cast<int>(numParts), numThreads, [&](int k) {
+      size_t headEnd = std::min(diags[k], splits[k+1]);
+      heads[k].assign(sorted.begin() + splits[k], sorted.begin() + headEnd);
+    });
+
+    backend.parallelFor(static_cast<int>(numParts), numThreads, [&](int k) {
+      size_t headEnd = splits[k] + heads[k].size();
+      size_t a = splits[k+1];
+      size_t b = diags[k+1] - splits[k+1];
+      size_t aBegin = splits[k];
+      size_t bBegin = diags[k] - splits[k];
+      for (size_t out = diags[k+1]; out-- > diags[k]; ) {
+        if (a == aBegin) {
+          sorted[out] = batch[--b];
+          continue;
+        }
+        const type& aValue = a - 1 < headEnd ? heads[k][a - 1 - aBegin] : sorted[a - 1];
+        if (b != bBegin && !(batch[b - 1] < aValue)) {
+          sorted[out] = batch[--b];
+        }
+        else {
+          sorted[out] = aValue;
+          --a;
+        }
+      }
+    });
+  }
+}
+
+#endif
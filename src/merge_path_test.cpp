@@ -0,0 +1,60 @@
+// Unit test for the merge path functions.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "merge_path.hpp"
+#include <cstdlib>
+#include <utility>
+#include <assert.h>
+
+using namespace SorterThreadedHelper;
+
+// Merges random sorted vectors of the given sizes with several thread
+// counts and compares with std::merge.  Values are pairs whose second
+// member records which input they came from, to check stability.
+void checkMerge(size_t numSorted, size_t numBatch, int maxValue) {
+  typedef std::pair<int, int> value;
+  std::vector<value> sortedIn(numSorted);
+  std::vector<value> batch(numBatch);
+  for (size_t i = 0; i < numSorted; ++i) {
+    sortedIn[i] = value(rand() % maxValue, 0);
+  }
+  for (size_t i = 0; i < numBatch; ++i) {
+    batch[i] = value(rand() % maxValue, 1);
+  }
+  std::sort(sortedIn.begin(), sortedIn.end());
+  std::sort(batch.begin(), batch.end());
+
+  std::vector<value> expected(numSorted + numBatch);
+  std::merge(sortedIn.begin(), sortedIn.end(), batch.begin(), batch.end(), expected.begin());
+
+  ThreadPoolBackend pool(4);
+  for (int numThreads = 1; numThreads <= 7; numThreads += 3) {
+    std::vector<value> sorted(sortedIn);
+    sorted.resize(numSorted + numBatch);
+    mergeInPlace<value>(sorted, numSorted, batch.begin(), batch.end(), pool, numThreads);
+    assert(sorted == expected);
+  }
+}
+
+int main(int argc, char **argv) {
+  std::vector<double> a(5);
+  std::vector<double> b(3);
+  a[0] = 1; a[1] = 3; a[2] = 5; a[3] = 7; a[4] = 9;
+  b[0] = 3; b[1] = 4; b[2] = 10;
+  // Merged: 1 3a 3b 4 5 7 9 10
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 0) == 0);
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 2) == 2);
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 3) == 2);
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 4) == 2);
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 7) == 5);
+  assert(mergePathSplit<double>(a.begin(), 5, b.begin(), 3, 8) == 5);
+
+  checkMerge(100000, 1000, 1000000);
+  checkMerge(1000, 100000, 1000000);
+  checkMerge(10000, 10000, 10);
+  checkMerge(0, 100, 10);
+  checkMerge(100, 0, 10);
+  checkMerge(3, 2, 10);
+}
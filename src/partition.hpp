@@ -11,7 +11,10 @@
 #include <set>
 #include <vector>
 #include <map>
+#include <algorithm>
 #include "partition_wall.hpp"
+#include "key_prefix.hpp"
+#include "pivot_classifier.hpp"
 
 namespace SorterThreadedHelper {
   // Each thread will have a partition and the members will
@@ -33,12 +36,15 @@ namespace SorterThreadedHelper {
       void fill(typename std::vector<type>::const_iterator begin,
                 typename std::vector<type>::const_iterator end);
 
+      // Returns the task that a value belongs in.
+      size_t task(const type& value) const;
+
       // Returns all of the values in the current task.  
       void popTask(typename std::vector<type>::iterator begin);
 
       // Returns the number of tasks (the size of the original pivot
       // set plus one).
-      size_t numTasks();
+      size_t numTasks() const;
 
       // Returns the index of the next task that will be popped by 
       // popTask().  
@@ -54,6 +60,11 @@ namespace SorterThreadedHelper {
     private:
       size_t numTasks_;
       size_t curTask_;
+      // Finds a value's task from the pivots without the map.
+      PivotClassifier<type> classifier_;
+      // The stacks of the map in task order.
+      std::vector<std::stack<type>*> stacks_;
+      void indexStacks();
       typename std::map<PartitionWall<type>, std::stack<type>*> partition_;
       typename std::map<PartitionWall<type>, std::stack<type>*>::iterator curTaskIt_;
   };
@@ -62,7 +73,8 @@ namespace SorterThreadedHelper {
   template <class type> 
   Partition<type>::Partition(const std::set<type>& pivots) :
     numTasks_(pivots.size()+1),
-    curTask_(0) {
+    curTask_(0),
+    classifier_(pivots) {
     // A partition is generated by a set of pivots
 
     // We will create a map between PartitionWalls and their associated stack.  
@@ -82,6 +94,17 @@ namespace SorterThreadedHelper {
     
     // curTaskIt_ keeps track of the next task to be popped by popTask()
     curTaskIt_ = partition_.begin();
+    indexStacks();
+  }
+
+  template <class type>
+  void Partition<type>::indexStacks() {
+    stacks_.clear();
+    stacks_.reserve(numTasks_);
+    for (typename std::map<PartitionWall<type>,std::stack<type>*>::iterator it = partition_.begin();
+         it != partition_.end(); ++it) {
+      stacks_.push_back(it->second);
+    }
   }
 
   template <class type>
@@ -96,7 +119,8 @@ namespace SorterThreadedHelper {
   template <class type>
   Partition<type>::Partition(const Partition& other) : 
     numTasks_(other.numTasks_), 
-    curTask_(other.curTask_) {
+    curTask_(other.curTask_),
+    classifier_(other.classifier_) {
     // Basic copy constructor.  
     std::pair<PartitionWall<type>,std::stack<type>*> pp;
 
@@ -111,12 +135,20 @@ namespace SorterThreadedHelper {
       }
       ++i;
     }
+    indexStacks();
   }     
 
   template <class type>
   void Partition<type>::fill(typename std::vector<type>::const_iterator chunkBegin,
                              typename std::vector<type>::const_iterator chunkEnd) {
     // Fills the stacks of the partition from the chunk
+    if (KeyPrefix<type>::enabled) {
+      for (typename std::vector<type>::const_iterator it = chunkBegin;
+           it != chunkEnd; ++it) {
+        stacks_[task(*it)]->push(*it);
+      }
+      return;
+    }
     typename std::map<PartitionWall<type>,std::stack<type>*>::iterator ub;
     PartitionWall<type> test;
     for (typename std::vector<type>::const_iterator it = chunkBegin;
@@ -129,6 +161,13 @@ namespace SorterThreadedHelper {
     }
   }
 
+  template <class type>
+  size_t Partition<type>::task(const type& value) const {
+    // The task is the number of pivots that are not greater than the
+    // value, the same task fill() puts it in.
+    return classifier_.task(value);
+  }
+
   template <class type>
   void Partition<type>::popTask(typename std::vector<type>::iterator begin) {
     // Fills the input vector with all of the values stored 
@@ -149,7 +188,7 @@ namespace SorterThreadedHelper {
   }
 
   template <class type>
-  size_t Partition<type>::numTasks() {
+  size_t Partition<type>::numTasks() const {
     return numTasks_;
   }
   
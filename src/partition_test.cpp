@@ -5,6 +5,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <string>
 #include <assert.h>
 #include "partition.hpp"
 
@@ -37,6 +38,11 @@ int main(int argc, char **argv) {
   }
   assert(sumTaskSizes == testSize);
 
+  // task() agrees with the pivots.
+  assert(part.task(*pivots.begin() - 1) == 0);
+  assert(part.task(*pivots.begin()) == 1);
+  assert(part.task(*pivots.rbegin()) == static_cast<size_t>(numPivots));
+
   std::vector<double> task(testSize);
   std::set<double>::iterator pivIt = pivots.begin();
   for (int i = 0; i < numTasks; ++i) {
@@ -52,4 +58,27 @@ int main(int argc, char **argv) {
       ++pivIt;
     }
   }
+
+  // Strings are classified by their KeyPrefix first.  The pivots
+  // "applesauce" and "applesxx" share a prefix with some values.
+  const char* words[] = {"apple", "applesauce", "applesaucy", "applesxx",
+                         "applesxy", "banana", "b", "", "cherry", "applesa"};
+  std::vector<std::string> wordVec(words, words + 10);
+  std::set<std::string> wordPivots;
+  wordPivots.insert("applesauce");
+  wordPivots.insert("applesxx");
+  wordPivots.insert("banana");
+  Partition<std::string> wordPart(wordPivots);
+  wordPart.fill(wordVec.begin(), wordVec.end());
+  std::vector<size_t> wordSizes;
+  wordPart.taskSizes(wordSizes);
+  std::vector<std::string> wordTask(wordVec.size());
+  for (size_t i = 0; i < wordPart.numTasks(); ++i) {
+    wordPart.popTask(wordTask.begin());
+    for (size_t j = 0; j < wordSizes[i]; ++j) {
+      size_t expected = std::distance(wordPivots.begin(), wordPivots.upper_bound(wordTask[j]));
+      assert(expected == i);
+      assert(wordPart.task(wordTask[j]) == i);
+    }
+  }
 }
@@ -0,0 +1,97 @@
+// PivotClassifier is a class used to find which interval between a
+// sorted set of pivots a value falls in, without storing anything.
+// Partition uses it to pick the stack for each value, and
+// SorterThreaded::quantiles() uses it to count the values in each
+// interval.  When the type has a KeyPrefix the pivots' prefixes are
+// kept in a contiguous array and searched first.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_pivot_classifier_hpp
+#define st_pivot_classifier_hpp
+
+#include <cstddef>
+#include <set>
+#include <vector>
+#include <algorithm>
+#include "key_prefix.hpp"
+
+namespace SorterThreadedHelper {
+
+  template <class type>
+  class PivotClassifier {
+    public:
+      // There are pivots.size() + 1 tasks.  Task i holds the values
+      // that are not less than pivot i - 1 and less than pivot i.
+      PivotClassifier(const std::set<type>& pivots);
+
+      // Returns the task that a value belongs in: the number of
+      // pivots that are not greater than the value.
+      size_t task(const type& value) const;
+
+      // Adds the number of values in a chunk that belong in each task
+      // to counts, without storing the values.
+      void count(typename std::vector<type>::const_iterator begin,
+                 typename std::vector<type>::const_iterator end,
+                 std::vector<size_t>& counts) const;
+
+      size_t numTasks() const;
+
+      // The pivots in order.
+      const std::vector<type>& pivots() const;
+
+    private:
+      std::vector<type> pivots_;
+      // The KeyPrefix of each pivot, when the trait is enabled.
+      std::vector<uint64_t> pivotPrefixes_;
+  };
+
+  template <class type>
+  PivotClassifier<type>::PivotClassifier(const std::set<type>& pivots) :
+    pivots_(pivots.begin(), pivots.end()) {
+    if (KeyPrefix<type>::enabled) {
+      pivotPrefixes_.reserve(pivots_.size());
+      for (size_t i = 0; i < pivots_.size(); ++i) {
+        pivotPrefixes_.push_back(KeyPrefix<type>::get(pivots_[i]));
+      }
+    }
+  }
+
+  template <class type>
+  size_t PivotClassifier<type>::task(const type& value) const {
+    if (KeyPrefix<type>::enabled) {
+      // Pivots with a smaller prefix are less than the value and those
+      // with a larger prefix are greater, so operator< is only needed
+      // for the pivots that share its prefix.
+      uint64_t prefix = KeyPrefix<type>::get(value);
+      size_t lo = std::lower_bound(pivotPrefixes_.begin(), pivotPrefixes_.end(), prefix) - pivotPrefixes_.begin();
+      size_t hi = std::upper_bound(pivotPrefixes_.begin() + lo, pivotPrefixes_.end(), prefix) - pivotPrefixes_.begin();
+      return std::upper_bound(pivots_.begin() + lo, pivots_.begin() + hi, value) - pivots_.begin();
+    }
+    return std::upper_bound(pivots_.begin(), pivots_.end(), value) - pivots_.begin();
+  }
+
+  template <class type>
+  void PivotClassifier<type>::count(typename std::vector<type>::const_iterator chunkBegin,
+                                    typename std::vector<type>::const_iterator chunkEnd,
+                                    std::vector<size_t>& counts) const {
+    counts.resize(numTasks(), 0);
+    for (typename std::vector<type>::const_iterator it = chunkBegin;
+         it != chunkEnd; ++it) {
+      ++counts[task(*it)];
+    }
+  }
+
+  template <class type>
+  size_t PivotClassifier<type>::numTasks() const {
+    return pivots_.size() + 1;
+  }
+
+  template <class type>
+  const std::vector<type>& PivotClassifier<type>::pivots() const {
+    return pivots_;
+  }
+}
+
+#endif
@@ -0,0 +1,58 @@
+// Unit test for the PivotClassifier class.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include <string>
+#include <algorithm>
+#include <assert.h>
+#include "pivot_classifier.hpp"
+
+using namespace SorterThreadedHelper;
+
+int main(int argc, char **argv) {
+  int testSize = 100000;
+  std::vector<double> testVec(testSize);
+  for (int i = 0; i < testSize; ++i) {
+    testVec[i] = i;
+  }
+  random_shuffle(testVec.begin(), testVec.end());
+  std::set<double> pivots;
+  pivots.insert(100.0);
+  pivots.insert(5000.5);
+  pivots.insert(70000.0);
+
+  PivotClassifier<double> classifier(pivots);
+  assert(classifier.numTasks() == 4);
+  assert(classifier.pivots().size() == 3);
+  assert(classifier.task(99.0) == 0);
+  assert(classifier.task(100.0) == 1);
+  assert(classifier.task(5000.5) == 2);
+  assert(classifier.task(1.0e9) == 3);
+
+  // Counting adds to the counts already there.
+  std::vector<size_t> counts;
+  classifier.count(testVec.begin(), testVec.end(), counts);
+  classifier.count(testVec.begin(), testVec.begin() + 1, counts);
+  assert(counts.size() == 4);
+  size_t extra = classifier.task(testVec[0]);
+  assert(counts[0] == 100 + (extra == 0));
+  assert(counts[1] == 4901 + (extra == 1));
+  assert(counts[2] == 64999 + (extra == 2));
+  assert(counts[3] == 30000 + (extra == 3));
+
+  // Strings search the pivot prefixes first, so values that share a
+  // prefix with pivots must still land between the right ones.
+  const char* words[] = {"apple", "applesauce", "applesaucy", "applesxx",
+                         "applesxy", "banana", "b", "", "cherry", "applesa"};
+  std::set<std::string> wordPivots;
+  wordPivots.insert("applesauce");
+  wordPivots.insert("applesxx");
+  wordPivots.insert("banana");
+  PivotClassifier<std::string> wordClassifier(wordPivots);
+  for (int i = 0; i < 10; ++i) {
+    std::string word(words[i]);
+    size_t expected = std::distance(wordPivots.begin(), wordPivots.upper_bound(word));
+    assert(wordClassifier.task(word) == expected);
+  }
+}
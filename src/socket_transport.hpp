@@ -0,0 +1,226 @@
+// SocketTransport class.  A Transport over connected Unix domain
+// stream sockets, one socket per pair of ranks.  The spawn() function
+// forks a job of any number of ranks on the local machine with the
+// sockets already connected, which is how the distributed sort is
+// tested on a single Linux box.  Processes started some other way
+// can build a SocketTransport from their own connected sockets.
+//
+// Each message is an eight byte length followed by the data.
+// exchange() uses poll() so that the send and the receive make
+// progress together.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_socket_transport_hpp
+#define st_socket_transport_hpp
+
+#include <cerrno>
+#include <cstdio>
+#include <stdint.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "transport.hpp"
+
+class SocketTransport : public Transport {
+  public:
+    // fds[r] is a socket connected to rank r; fds[rank] is ignored.
+    // The transport closes the sockets when it is destroyed.
+    SocketTransport(int rank, const std::vector<int>& fds);
+    ~SocketTransport();
+
+    // Forks numRanks - 1 child processes connected to the calling
+    // process and to each other.  Returns the transport for the rank
+    // of the process it returns in: 0 in the caller, 1 to numRanks - 1
+    // in the children.  Children should leave with _exit() when they
+    // are done.  Call before starting any threads.
+    static SocketTransport* spawn(int numRanks);
+
+    // On rank 0 of a spawn()ed job, waits for the children to exit
+    // and returns true if they all exited with status 0.
+    bool join();
+
+    int rank();
+    int size();
+    void exchange(int dest, const std::vector<char>& sendBuf,
+                  int source, std::vector<char>& recvBuf);
+
+  private:
+    SocketTransport(const SocketTransport& other);
+    int rank_;
+    std::vector<int> fds_;
+    std::vector<pid_t> children_;
+};
+
+inline SocketTransport::SocketTransport(int rank, const std::vector<int>& fds) :
+  rank_(rank),
+  fds_(fds) {
+  if (rank < 0 || rank >= static_cast<int>(fds.size())) {
+    throw SorterThreadedException(SorterThreadedException::TransportRank);
+  }
+}
+
+inline SocketTransport::~SocketTransport() {
+  for (size_t i = 0; i < fds_.size(); ++i) {
+    if (static_cast<int>(i) != rank_ && fds_[i] != -1) {
+      close(fds_[i]);
+    }
+  }
+}
+
+inline SocketTransport* SocketTransport::spawn(int numRanks) {
+  // ends[i][j] is rank i's end of the socket between ranks i and j.
+  std::vector<std::vector<int> > ends(numRanks, std::vector<int>(numRanks, -1));
+  for (int i = 0; i < numRanks; ++i) {
+    for (int j = i + 1; j < numRanks; ++j) {
+      int sv[2];
+      if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) != 0) {
+        throw SorterThreadedException(SorterThreadedException::TransportIO);
+      }
+      ends[i][j] = sv[0];
+      ends[j][i] = sv[1];
+    }
+  }
+
+  // Anything buffered would otherwise be written by every process.
+  std::fflush(NULL);
+  int rank = 0;
+  std::vector<pid_t> children;
+  for (int r = 1; r < numRanks; ++r) {
+    pid_t pid = fork();
+    if (pid == -1) {
+      throw SorterThreadedException(SorterThreadedException::TransportIO);
+    }
+    if (pid == 0) {
+      rank = r;
+      children.clear();
+      break;
+    }
+    children.push_back(pid);
+  }
+
+  // Keep this rank's ends and close everyone else's.
+  for (int i = 0; i < numRanks; ++i) {
+    for (int j = 0; j < numRanks; ++j) {
+      if (i != rank && ends[i][j] != -1) {
+        close(ends[i][j]);
+      }
+    }
+  }
+  SocketTransport* transport = new SocketTransport(rank, ends[rank]);
+  transport->children_ = children;
+  return transport;
+}
+
+inline bool SocketTransport::join() {
+  bool success = true;
+  for (size_t i = 0; i < children_.size(); ++i) {
+    int status = 0;
+    if (waitpid(children_[i], &status, 0) == -1 ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+      success = false;
+    }
+  }
+  children_.clear();
+  return success;
+}
+
+inline int SocketTransport::rank() {
+  return rank_;
+}
+
+inline int SocketTransport::size() {
+  return static_cast<int>(fds_.size());
+}
+
+inline void SocketTransport::exchange(int dest, const std::vector<char>& sendBuf,
+                                      int source, std::vector<char>& recvBuf) {
+  if (dest == rank_ || source == rank_ ||
+      dest >= size() || source >= size()) {
+    throw SorterThreadedException(SorterThreadedException::TransportRank);
+  }
+
+  // Progress through the header and then the data in each direction.
+  uint64_t sendHeader = sendBuf.size();
+  uint64_t recvHeader = 0;
+  size_t sendPos = 0;
+  size_t recvPos = 0;
+  size_t sendTotal = dest == -1 ? 0 : sizeof(sendHeader) + sendBuf.size();
+  bool recvDone = source == -1;
+  bool recvSized = false;
+
+  while (sendPos < sendTotal || !recvDone) {
+    pollfd fds[2];
+    int numFds = 0;
+    int sendFd = -1;
+    int recvFd = -1;
+    if (sendPos < sendTotal) {
+      fds[numFds].fd = fds_[dest];
+      fds[numFds].events = POLLOUT;
+      sendFd = numFds++;
+    }
+    if (!recvDone) {
+      fds[numFds].fd = fds_[source];
+      fds[numFds].events = POLLIN;
+      recvFd = numFds++;
+    }
+    if (poll(fds, numFds, -1) == -1) {
+      if (errno == EINTR) continue;
+      throw SorterThreadedException(SorterThreadedException::TransportIO);
+    }
+
+    if (sendFd != -1 && fds[sendFd].revents != 0) {
+      const char* data;
+      size_t left;
+      if (sendPos < sizeof(sendHeader)) {
+        data = reinterpret_cast<const char*>(&sendHeader) + sendPos;
+        left = sizeof(sendHeader) - sendPos;
+      }
+      else {
+        data = &sendBuf[sendPos - sizeof(sendHeader)];
+        left = sendTotal - sendPos;
+      }
+      ssize_t sent = send(fds_[dest], data, left, MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (sent == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        throw SorterThreadedException(SorterThreadedException::TransportIO);
+      }
+      if (sent > 0) {
+        sendPos += sent;
+      }
+    }
+
+    if (recvFd != -1 && fds[recvFd].revents != 0) {
+      char* data;
+      size_t left;
+      if (!recvSized) {
+        data = reinterpret_cast<char*>(&recvHeader) + recvPos;
+        left = sizeof(recvHeader) - recvPos;
+      }
+      else {
+        data = &recvBuf[recvPos];
+        left = recvBuf.size() - recvPos;
+      }
+      ssize_t got = recv(fds_[source], data, left, MSG_DONTWAIT);
+      if (got == 0 ||
+          (got == -1 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        throw SorterThreadedException(SorterThreadedException::TransportIO);
+      }
+      if (got > 0) {
+        recvPos += got;
+      }
+      if (!recvSized && recvPos == sizeof(recvHeader)) {
+        recvBuf.resize(recvHeader);
+        recvSized = true;
+        recvPos = 0;
+      }
+      if (recvSized && recvPos == recvBuf.size()) {
+        recvDone = true;
+      }
+    }
+  }
+}
+
+#endif
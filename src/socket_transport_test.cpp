@@ -0,0 +1,67 @@
+// Unit test for the SocketTransport class and the collective
+// operations in transport.hpp.  Forks a four rank job.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "socket_transport.hpp"
+#include <assert.h>
+
+using namespace SorterThreadedHelper;
+
+int main(int argc, char **argv) {
+  int numRanks = 4;
+  SocketTransport* transport = SocketTransport::spawn(numRanks);
+  int rank = transport->rank();
+  assert(transport->size() == numRanks);
+
+  // Messages to each rank are large enough to fill the socket
+  // buffers, so this deadlocks unless send and receive overlap.
+  size_t bigSize = 1 << 20;
+  std::vector<std::vector<char> > sendBufs(numRanks);
+  for (int r = 0; r < numRanks; ++r) {
+    sendBufs[r].assign(bigSize + r, static_cast<char>(rank * numRanks + r));
+  }
+  std::vector<std::vector<char> > recvBufs;
+  allToAll(*transport, sendBufs, recvBufs);
+  assert(static_cast<int>(recvBufs.size()) == numRanks);
+  for (int r = 0; r < numRanks; ++r) {
+    assert(recvBufs[r].size() == bigSize + rank);
+    assert(recvBufs[r][0] == static_cast<char>(r * numRanks + rank));
+    assert(recvBufs[r][bigSize + rank - 1] == static_cast<char>(r * numRanks + rank));
+  }
+
+  std::vector<double> values(rank + 1, static_cast<double>(rank));
+  std::vector<char> buf;
+  pack<double>(values.begin(), values.end(), buf);
+  gather(*transport, 1, buf, recvBufs);
+  if (rank == 1) {
+    for (int r = 0; r < numRanks; ++r) {
+      unpack(recvBufs[r], values);
+      assert(values.size() == static_cast<size_t>(r + 1));
+      assert(values[r] == static_cast<double>(r));
+    }
+  }
+
+  buf.clear();
+  if (rank == 2) {
+    buf.assign(5, 'x');
+  }
+  broadcast(*transport, 2, buf);
+  assert(buf == std::vector<char>(5, 'x'));
+
+  // An empty message is still a message.
+  std::vector<char> empty;
+  std::vector<char> got(3, 'y');
+  int next = (rank + 1) % numRanks;
+  int prev = (rank + numRanks - 1) % numRanks;
+  transport->exchange(next, empty, prev, got);
+  assert(got.empty());
+
+  if (rank != 0) {
+    delete transport;
+    _exit(0);
+  }
+  assert(transport->join());
+  delete transport;
+}
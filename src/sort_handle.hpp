@@ -0,0 +1,219 @@
+// SortHandle class.  Returned by SorterThreaded::sortAsync() to
+// follow a sort that is running on a background thread.  The wait()
+// method blocks until the whole range is sorted.  The next() method
+// hands back the sorted tasks one at a time in taskOffsets order, so
+// the caller can consume the low end of the range while the rest is
+// still being sorted.
+//
+// SorterThreadedHelper::SortProgress is the state shared between the
+// handle and the background thread.  The sort reports the task
+// boundaries once the partition step is done and then marks each
+// task as it is sorted.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_sort_handle_hpp
+#define st_sort_handle_hpp
+
+#include <cstddef>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+
+namespace SorterThreadedHelper {
+
+  template <class type>
+  class SortProgress {
+    public:
+      typedef typename std::vector<type>::iterator iterator;
+      SortProgress();
+      // Joins the background thread if one was started.  If the last
+      // handle is dropped on the background thread itself, e.g. by the
+      // callback that held it, the thread is detached instead; it has
+      // finished with this object by then.
+      ~SortProgress();
+
+      // Runs work on a background thread owned by this object.
+      void start(const std::function<void()>& work);
+
+      // Called by the sort once the task boundaries are known.
+      // taskOffsets[i] is the beginning of task i and end is the end
+      // of the last task.
+      void setTasks(const std::vector<iterator>& taskOffsets, iterator end);
+
+      // Called by the sort when a task has been sorted.
+      void taskDone(size_t task);
+
+      // Records an exception thrown by the sort or its callback; the
+      // first one recorded is rethrown by wait() and next().
+      void fail(std::exception_ptr error);
+
+      // Called when the sort has returned.
+      void finish();
+
+      void wait();
+      bool done();
+      bool next(iterator& taskBegin, iterator& taskEnd);
+
+    private:
+      SortProgress(const SortProgress& other);
+      std::mutex mutex_;
+      std::condition_variable changed_;
+      std::thread worker_;
+      bool tasksSet_;
+      bool finished_;
+      std::exception_ptr error_;
+      size_t nextTask_;
+      std::vector<iterator> bounds_;
+      std::vector<char> taskDone_;
+  };
+
+  template <class type>
+  SortProgress<type>::SortProgress() :
+    tasksSet_(false),
+    finished_(false),
+    nextTask_(0) {}
+
+  template <class type>
+  SortProgress<type>::~SortProgress() {
+    if (worker_.joinable()) {
+      if (worker_.get_id() == std::this_thread::get_id()) {
+        worker_.detach();
+      }
+      else {
+        worker_.join();
+      }
+    }
+  }
+
+  template <class type>
+  void SortProgress<type>::start(const std::function<void()>& work) {
+    worker_ = std::thread(work);
+  }
+
+  template <class type>
+  void SortProgress<type>::setTasks(const std::vector<iterator>& taskOffsets,
+                                    iterator end) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    bounds_ = taskOffsets;
+    bounds_.push_back(end);
+    taskDone_.assign(taskOffsets.size(), 0);
+    tasksSet_ = true;
+    changed_.notify_all();
+  }
+
+  template <class type>
+  void SortProgress<type>::taskDone(size_t task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    taskDone_[task] = 1;
+    // Only the task the consumer is waiting for can wake it up.
+    if (task == nextTask_) {
+      changed_.notify_all();
+    }
+  }
+
+  template <class type>
+  void SortProgress<type>::fail(std::exception_ptr error) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!error_) {
+      error_ = error;
+    }
+  }
+
+  template <class type>
+  void SortProgress<type>::finish() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_ = true;
+    changed_.notify_all();
+  }
+
+  template <class type>
+  void SortProgress<type>::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!finished_) {
+      changed_.wait(lock);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+
+  template <class type>
+  bool SortProgress<type>::done() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+  }
+
+  template <class type>
+  bool SortProgress<type>::next(iterator& taskBegin, iterator& taskEnd) {
+    // Waits until the next task in order has been sorted.  If the
+    // sort finishes first (it failed or never reported its tasks)
+    // stop waiting.
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!finished_ &&
+           (!tasksSet_ ||
+            (nextTask_ < taskDone_.size() && !taskDone_[nextTask_]))) {
+      changed_.wait(lock);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    if (!tasksSet_ || nextTask_ == taskDone_.size()) {
+      return false;
+    }
+    taskBegin = bounds_[nextTask_];
+    taskEnd = bounds_[nextTask_ + 1];
+    ++nextTask_;
+    return true;
+  }
+}
+
+template <class type>
+class SortHandle {
+  public:
+    typedef typename std::vector<type>::iterator iterator;
+    SortHandle(const std::shared_ptr<SorterThreadedHelper::SortProgress<type> >& progress);
+
+    // Blocks until the whole range is sorted and the callback given
+    // to sortAsync(), if any, has returned.
+    void wait();
+
+    // Returns true once wait() would not block.
+    bool done();
+
+    // Blocks until the next task in taskOffsets order is sorted and
+    // sets taskBegin and taskEnd to its bounds.  Returns false once
+    // every task has been handed out.  The tasks returned cover the
+    // range in order, and once next() has returned a task the
+    // background sort no longer touches it.
+    bool next(iterator& taskBegin, iterator& taskEnd);
+
+  private:
+    std::shared_ptr<SorterThreadedHelper::SortProgress<type> > progress_;
+};
+
+template <class type>
+SortHandle<type>::SortHandle(const std::shared_ptr<SorterThreadedHelper::SortProgress<type> >& progress) :
+  progress_(progress) {}
+
+template <class type>
+void SortHandle<type>::wait() {
+  progress_->wait();
+}
+
+template <class type>
+bool SortHandle<type>::done() {
+  return progress_->done();
+}
+
+template <class type>
+bool SortHandle<type>::next(iterator& taskBegin, iterator& taskEnd) {
+  return progress_->next(taskBegin, taskEnd);
+}
+
+#endif
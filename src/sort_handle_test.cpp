@@ -0,0 +1,63 @@
+// Unit test for the SortHandle and SorterThreadedHelper::SortProgress
+// classes.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "sort_handle.hpp"
+#include <assert.h>
+
+using namespace SorterThreadedHelper;
+
+int main(int argc, char **argv) {
+  std::vector<double> testVec(10);
+  std::vector<std::vector<double>::iterator> offsets(3);
+  offsets[0] = testVec.begin();
+  offsets[1] = testVec.begin() + 4;
+  offsets[2] = testVec.begin() + 7;
+
+  std::shared_ptr<SortProgress<double> > progress(new SortProgress<double>);
+  SortHandle<double> handle(progress);
+  std::vector<double>::iterator taskBegin, taskEnd;
+
+  // Tasks are finished out of order on a background thread and must
+  // come back from next() in order.
+  progress->start([&]() {
+    progress->setTasks(offsets, testVec.end());
+    progress->taskDone(2);
+    progress->taskDone(0);
+    progress->taskDone(1);
+    progress->finish();
+  });
+
+  assert(handle.next(taskBegin, taskEnd));
+  assert(taskBegin == testVec.begin() && taskEnd == testVec.begin() + 4);
+  assert(handle.next(taskBegin, taskEnd));
+  assert(taskBegin == testVec.begin() + 4 && taskEnd == testVec.begin() + 7);
+  assert(handle.next(taskBegin, taskEnd));
+  assert(taskBegin == testVec.begin() + 7 && taskEnd == testVec.end());
+  assert(!handle.next(taskBegin, taskEnd));
+  handle.wait();
+  assert(handle.done());
+
+  // An exception on the background thread is rethrown by wait().
+  std::shared_ptr<SortProgress<double> > failed(new SortProgress<double>);
+  SortHandle<double> failedHandle(failed);
+  failed->start([&]() {
+    try {
+      throw 1;
+    }
+    catch (...) {
+      failed->fail(std::current_exception());
+    }
+    failed->finish();
+  });
+  bool caught = false;
+  try {
+    failedHandle.wait();
+  }
+  catch (int) {
+    caught = true;
+  }
+  assert(caught);
+}
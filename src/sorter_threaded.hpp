@@ -1,13 +1,50 @@
 // SorterThreaded class.  Has a sort() member function that will use
-// OpenMP threading to sort a vector.  The taskFactor determines the
+// threading to sort a vector.  The taskFactor determines the
 // number of tasks that the problem will be broken up into, where the
 // number of tasks is the number of threads times the task factor.
-// The number of threads used can be lowered from the
-// omp_get_max_threads by setting maxThreads to a value other than -1.
+// The number of threads used can be lowered from the backend's
+// maxThreads() by setting maxThreads to a value other than -1.
 // The scaling of the partitioning step is O(numEl*log(numTasks)) in
 // time and the the sort algorithm is then called on each task.  The
 // built in std::sort() is used if STL_SORT_THREAD_SAFE is defined,
-// otherwise a thread safe quick_sort is used.
+// otherwise a thread safe quick_sort is used.  For types with a
+// KeyPrefix (see key_prefix.hpp) the partition and std::sort() steps
+// compare cached 64 bit prefixes before calling operator<.
+//
+// The insert() member function adds a batch of values to a vector
+// that is already sorted.  Only the batch is sorted; it is then merged
+// into the vector in parallel, so the cost is that of sorting the
+// batch plus one linear merge.
+//
+// The groupBy() member function only brings equal values together.
+// It uses the same partition step with a HashPartition, so values
+// are spread over the tasks by hash, and then groups each task with
+// an open addressing hash table of indices.  Tasks are kept small
+// enough for their tables to stay in cache, even on one thread.  No
+// values are compared for order.
+//
+// The quantiles() member function uses the sampling step and counts
+// how many values fall between each pair of pivots.  That brackets
+// the requested quantiles with known rank error, and if exact answers
+// are wanted only the buckets holding them need to be searched.
+//
+// All of the parallel work goes through a ThreadBackend, set with
+// setBackend().  The default is OpenMP when it is available and
+// serial otherwise; see thread_backend.hpp for a std::thread pool and
+// for running on threads owned by the caller.
+//
+// The sortByKey() member function sorts a key column and applies the
+// same reordering to any number of payload columns.  Only the keys go
+// through the partition and sort steps; each payload column is then
+// permuted in place by following the cycles of the permutation, so
+// every payload value is moved once.  Columns are permuted in
+// parallel with each other.
+//
+// The sortAsync() member function runs sort() on a background thread
+// and returns a SortHandle.  The handle can wait() for the sort, or
+// hand back the tasks in order with next() as soon as each one has
+// been sorted.  An optional callback is run on the background thread
+// when the sort is complete, before wait() returns.
 //
 // C.M. Cantalupo 2011
 // cmcantalupo@gmail.com
@@ -18,12 +55,16 @@
 #include <string>
 #include <vector>
 #include <algorithm>
-#ifdef _OPENMP
-#include <omp.h>
-#include <iostream>
-#endif
+#include <cmath>
+#include <memory>
+#include "thread_backend.hpp"
 #include "partition.hpp"
 #include "splinter.hpp"
+#include "key_index.hpp"
+#include "key_prefix.hpp"
+#include "merge_path.hpp"
+#include "hash_partition.hpp"
+#include "sort_handle.hpp"
 #ifndef STL_SORT_THREAD_SAFE
 #include "quick_sort.hpp"
 #endif
@@ -34,12 +75,111 @@ class SorterThreaded {
     SorterThreaded(int taskFactor=8, int maxThreads=-1);
     void sort(typename std::vector<type>::iterator begin, 
               typename std::vector<type>::iterator end);
+    template <class... payload_iterators>
+    void sortByKey(typename std::vector<type>::iterator keyBegin,
+                   typename std::vector<type>::iterator keyEnd,
+                   payload_iterators... payloadBegins);
+    // Rearranges [begin, end) into pivots.size() + 1 tasks without
+    // sorting them.  Task i holds the values that are less than the
+    // i-th pivot and not less than the pivot before it; the last
+    // task holds the values not less than any pivot.  taskOffsets is
+    // set to the beginning of each task.  pivots must not be empty.
+    void partition(typename std::vector<type>::iterator begin,
+                   typename std::vector<type>::iterator end,
+                   const std::set<type>& pivots,
+                   std::vector<typename std::vector<type>::iterator>& taskOffsets);
+    // sorted must already be sorted.  Sorts [batchBegin, batchEnd) in
+    // place and merges it into sorted, which keeps its order with
+    // equal values from the batch after those already in sorted.  The
+    // batch is read where it is, so it should be in another vector.
+    // A batch that is the tail of sorted, appended since it was last
+    // sorted, is copied out first; any other range of sorted throws
+    // SorterThreadedException::InsertAliased.
+    void insert(std::vector<type>& sorted,
+                typename std::vector<type>::iterator batchBegin,
+                typename std::vector<type>::iterator batchEnd);
+    // Rearranges [begin, end) so that equal values are next to each
+    // other, without putting the groups in order.  Values are spread
+    // over the tasks by hash instead of by pivots, and each task is
+    // then grouped on its own.  groups is set to the beginning of each
+    // group.  type needs operator== and a hash, std::hash by default.
+    template <class hasher = std::hash<type> >
+    void groupBy(typename std::vector<type>::iterator begin,
+                 typename std::vector<type>::iterator end,
+                 std::vector<typename std::vector<type>::iterator>& groups,
+                 const hasher& hash = hasher());
+    // Finds the values at fractions probs of the way through the
+    // sorted order of [begin, end) without sorting it.  The rank of
+    // values[i] in the sorted order is within the returned bound of
+    // round(probs[i] * (n - 1)).  The range is split into about
+    // numBuckets buckets by sampled pivots and the buckets are only
+    // counted, so the bound is about n / numBuckets.  If exact is true
+    // the requested ranks are selected from the buckets holding them,
+    // values are exact and 0 is returned.  The range is not modified.
+    // A NaN in probs throws SorterThreadedException::QuantileNaN.
+    size_t quantiles(typename std::vector<type>::iterator begin,
+                     typename std::vector<type>::iterator end,
+                     const std::vector<double>& probs,
+                     std::vector<type>& values,
+                     bool exact=false, size_t numBuckets=1024);
+    SortHandle<type> sortAsync(typename std::vector<type>::iterator begin,
+                               typename std::vector<type>::iterator end,
+                               const std::function<void()>& callback = std::function<void()>());
     void setTaskFactor(int taskFactor);
     void setMaxThreads(int maxThreads);
+    // The largest number of tasks a single partition step creates.
+    // More tasks are made by partitioning again, up to three levels.
+    // Values below 2 are raised to 2.  If three levels of maxFanOut
+    // tasks are still too few, the fan-out is raised to the cube root
+    // of the number of tasks.
+    void setMaxFanOut(int maxFanOut);
+    // The backend is not owned by the sorter and must outlive it.
+    // NULL selects defaultBackend().
+    void setBackend(ThreadBackend* backend);
   private:
     int taskFactor_;
-    // If numThreads_ == -1 then omp_get_max_threads will be used
+    // If maxThreads_ == -1 then the backend's maxThreads() will be used
     int maxThreads_;
+    int maxFanOut_;
+    // Vectors are not split into tasks shorter than this on average.
+    size_t minTaskSize_;
+    // groupBy() splits vectors into tasks of about this size or less,
+    // whatever the number of threads.
+    size_t groupTaskSize_;
+    ThreadBackend* backend_;
+    ThreadBackend& backend();
+    // Number of threads to use: the backend's maxThreads() limited by
+    // maxThreads_.
+    int numThreads();
+    // sort() reporting the task boundaries and each sorted task to
+    // progress if it is not NULL.
+    void sort(typename std::vector<type>::iterator begin,
+              typename std::vector<type>::iterator end,
+              SorterThreadedHelper::SortProgress<type>* progress);
+    // The partition step for any class with the interface of
+    // Partition.  Each thread works on its own copy of prototype.
+    template <class partition_type>
+    void scatter(typename std::vector<type>::iterator begin,
+                 typename std::vector<type>::iterator end,
+                 const partition_type& prototype,
+                 std::vector<typename std::vector<type>::iterator>& taskOffsets);
+    // Chooses up to numPivots unique pivots from a sample of the range
+    // that are all larger than its smallest value.
+    void samplePivots(typename std::vector<type>::iterator begin,
+                      typename std::vector<type>::iterator end,
+                      size_t numPivots,
+                      std::set<type>& pivots);
+    // Sorts the range as a single task.
+    void sortSerial(typename std::vector<type>::iterator begin,
+                    typename std::vector<type>::iterator end,
+                    SorterThreadedHelper::SortProgress<type>* progress);
+    void permutePayloads(const std::vector<size_t>& perm,
+                         std::vector<std::function<void()> >& columns);
+    template <class payload_iterator, class... payload_iterators>
+    void permutePayloads(const std::vector<size_t>& perm,
+                         std::vector<std::function<void()> >& columns,
+                         payload_iterator payloadBegin,
+                         payload_iterators... payloadBegins);
 };
 
   // We need to break the input vector into nearly equal size chunks
@@ -48,141 +188,541 @@ class SorterThreaded {
   // We can build up a Partition from an array of non-repeating 
   // values (pivots) from the input vector.  
   //
-  // Each thread makes its own Partition.  These are OpenMP private.
-  // Each partition has a stack for each thread and each task.  This
-  // implies that the total number of stacks over all threads is
-  // numThreads^3 * taskFactor_.
+  // Each thread makes its own Partition.
+  // Each partition has a stack for each task at the current level.
+  // This implies that the total number of stacks over all threads is
+  // numThreads times the fan-out, which is at most maxFanOut_.
  
 
 template <class type>
 void SorterThreaded<type>::sort(typename std::vector<type>::iterator begin, 
                           typename std::vector<type>::iterator end) {
+  sort(begin, end, NULL);
+}
+
+template <class type>
+void SorterThreaded<type>::sort(typename std::vector<type>::iterator begin, 
+                                typename std::vector<type>::iterator end,
+                                SorterThreadedHelper::SortProgress<type>* progress) {
   // To achieve parallelism here we will choose a set of pivots from 
-  // the list to be sorted.  Here we will just choose the first elements
-  // in the vector.  The number of pivots will determine the number of 
-  // tasks to be done: one more task than the number of pivots. 
+  // the list to be sorted.  The pivots are taken from an evenly
+  // spaced sample of the vector.  The number of pivots will
+  // determine the number of tasks to be done: one more task than the
+  // number of pivots.
   //
   // For simplicity here the number of tasks is chosen to be a factor
   // of the number of threads.  This is determined by the class
-  // attribute taskFactor_.
+  // attribute taskFactor_.  It is reduced for short vectors so that
+  // tasks have at least minTaskSize_ elements on average.
   //
   // We need to break down the main scaling dimension of the problem,
   // the length of the input vector.  The first thing that we want to
   // do with the input is to partition it into intervals bounded by
-  // the pivots.  This is done with the std::map.upper_bound().  In
-  // the end we want taskFactor_ times the number of threads jobs and
-  // we need one fewer pivot than that to do so.  Map the intervals to
-  // a stack with a std::map.
+  // the pivots.  This is done with the std::map.upper_bound().  Each
+  // interval goes to its own stack, so the fan-out of a partition is
+  // the number of write streams each thread has open.  To keep that
+  // within the caches and TLB the fan-out is capped at maxFanOut_:
+  // if more tasks are needed the partition is repeated on each
+  // interval, for up to three levels.
  
-  // If there is no OpenMP just use std::sort()
-#ifndef _OPENMP
-  std::sort(begin, end);
-#else
-  // Get the number of threads and reset it if the attribute
-  // maxThreads_ is smaller
-  int numThreads = omp_get_max_threads();
+  int numThreads = this->numThreads();
+  size_t numEl = std::distance(begin, end);
 
-  if (maxThreads_ != -1 && maxThreads_ < numThreads) {
-    numThreads = maxThreads_;
+  size_t numTasks = static_cast<size_t>(numThreads) * taskFactor_;
+  if (numTasks > numEl / minTaskSize_) {
+    numTasks = numEl / minTaskSize_;
   }
 
   // If there is just one thread use std::sort()
-  if (numThreads == 1) {
-    std::sort(begin,end);
+  if (numThreads == 1 || numTasks < 2) {
+    sortSerial(begin, end, progress);
     return;
   }
 
-  int numTasks = numThreads * taskFactor_;
+  // Pick the fewest levels, and the smallest fan-out for them, that
+  // reach numTasks.
+  int numLevels = 1;
+  size_t fanOut = numTasks;
+  while (fanOut > static_cast<size_t>(maxFanOut_) && numLevels < 3) {
+    ++numLevels;
+    fanOut = static_cast<size_t>(std::ceil(std::pow(static_cast<double>(numTasks), 1.0 / numLevels)));
+    if (std::pow(static_cast<double>(fanOut), numLevels) < numTasks) {
+      ++fanOut;
+    }
+    else if (std::pow(static_cast<double>(fanOut - 1), numLevels) >= numTasks) {
+      --fanOut;
+    }
+  }
+
+  // Each level splits every interval of the level above.  Intervals
+  // that are too short or have only one value are left alone.
+  std::vector<typename std::vector<type>::iterator> taskOffsets(1, begin);
+  for (int level = 0; level < numLevels; ++level) {
+    std::vector<typename std::vector<type>::iterator> levelOffsets;
+    for (size_t i = 0; i < taskOffsets.size(); ++i) {
+      typename std::vector<type>::iterator taskBegin = taskOffsets[i];
+      typename std::vector<type>::iterator taskEnd = i != taskOffsets.size() - 1 ? taskOffsets[i+1] : end;
+      std::set<type> pivots;
+      if (static_cast<size_t>(std::distance(taskBegin, taskEnd)) >= 2 * minTaskSize_) {
+        samplePivots(taskBegin, taskEnd, fanOut - 1, pivots);
+      }
+      if (pivots.empty()) {
+        levelOffsets.push_back(taskBegin);
+        continue;
+      }
+      std::vector<typename std::vector<type>::iterator> subOffsets;
+      partition(taskBegin, taskEnd, pivots, subOffsets);
+      levelOffsets.insert(levelOffsets.end(), subOffsets.begin(), subOffsets.end());
+    }
+    taskOffsets.swap(levelOffsets);
+  }
+  int numSorts = taskOffsets.size();
 
-  std::set<type> pivots;
-  // Create a set of pivots by going through the vector    
-  for (typename std::vector<type>::iterator it = begin;
-       it != end && pivots.size() < numThreads*taskFactor_ - 1;
-       ++it) {
-      pivots.insert(*it);
-  }
-  // Check that there were as many unique values as we need otherwise
-  // use std::sort()
-  if (pivots.size() < numThreads * taskFactor_ - 1) {
-    std::sort(begin, end);
-    return;
+  if (progress != NULL) {
+    progress->setTasks(taskOffsets, end);
   }
-  
+
+  // This loop sorts the partitioned intervals.  The backend hands out
+  // the tasks in order, so the low end of the range is finished first.
+  backend().parallelFor(numSorts, numThreads, [&](int i) {
+    typename std::vector<type>::iterator taskEnd = i != numSorts - 1 ? taskOffsets[i+1] : end;
+#ifdef STL_SORT_THREAD_SAFE
+    SorterThreadedHelper::prefixSort<type>(taskOffsets[i], taskEnd);
+#else
+    SorterThreadedHelper::quick_sort<type>(taskOffsets[i], taskEnd);
+#endif
+    if (progress != NULL) {
+      progress->taskDone(i);
+    }
+  });
+}
+
+template <class type>
+void SorterThreaded<type>::samplePivots(typename std::vector<type>::iterator begin,
+                                        typename std::vector<type>::iterator end,
+                                        size_t numPivots,
+                                        std::set<type>& pivots) {
+  // Sort an evenly spaced sample a few times larger than the number
+  // of pivots and take evenly spaced values from it.  Repeated values
+  // can leave fewer pivots than asked for.
+  size_t numEl = std::distance(begin, end);
+  size_t numSamples = numPivots * 4 + 3;
+  if (numSamples > numEl) {
+    numSamples = numEl;
+  }
+  std::vector<type> samples(numSamples);
+  for (size_t i = 0; i < numSamples; ++i) {
+    samples[i] = begin[i * numEl / numSamples];
+  }
+  std::sort(samples.begin(), samples.end());
+  pivots.clear();
+  for (size_t i = 1; i <= numPivots && numSamples != 0; ++i) {
+    pivots.insert(samples[i * numSamples / (numPivots + 1)]);
+  }
+  // The smallest value makes an empty first task.
+  if (!pivots.empty() && !(samples.front() < *pivots.begin())) {
+    pivots.erase(pivots.begin());
+  }
+}
+
+template <class type>
+void SorterThreaded<type>::partition(typename std::vector<type>::iterator begin,
+                                     typename std::vector<type>::iterator end,
+                                     const std::set<type>& pivots,
+                                     std::vector<typename std::vector<type>::iterator>& taskOffsets) {
+  scatter(begin, end, SorterThreadedHelper::Partition<type>(pivots), taskOffsets);
+}
+
+template <class type>
+template <class partition_type>
+void SorterThreaded<type>::scatter(typename std::vector<type>::iterator begin,
+                                   typename std::vector<type>::iterator end,
+                                   const partition_type& prototype,
+                                   std::vector<typename std::vector<type>::iterator>& taskOffsets) {
+  ThreadBackend& backend = this->backend();
+  int numThreads = this->numThreads();
+  int numTasks = prototype.numTasks();
+
   // Break the input vector into evenly sized chunks.  
   SorterThreadedHelper::Splinter<type> splinter(begin, end, numTasks);
   std::vector<typename std::vector<type>::iterator> chunks;
   splinter.even(numThreads, chunks);
 
-  // taskOffsets is a shared variable, so declare it outside of the
-  // omp parallel region
-  std::vector<typename std::vector<type>::iterator> taskOffsets(numTasks);
+  // The partitions live between the fill and pop steps, which are
+  // separate parallel loops so that no backend needs a barrier.
+  std::vector<std::unique_ptr<partition_type> > partitions(numThreads);
+  std::vector<std::vector<size_t> > sizes(numThreads);
+  std::vector<std::vector<typename std::vector<type>::iterator> > offsets(numThreads);
 
-  //This parallel region is for the partition step.  
-#pragma omp parallel default (shared) num_threads (numThreads)
-{
-  int threadID = omp_get_thread_num();
-  SorterThreadedHelper::Partition<type> partition(pivots);
   // Fill each thread's partition with a chunk of the vector.  
-  partition.fill(chunks[threadID], chunks[threadID+1]);
+  backend.parallelFor(numThreads, numThreads, [&](int threadID) {
+    partitions[threadID].reset(new partition_type(prototype));
+    partitions[threadID]->fill(chunks[threadID], chunks[threadID+1]);
+    partitions[threadID]->taskSizes(sizes[threadID]);
+  });
 
-  std::vector<size_t> mySizes;
-  partition.taskSizes(mySizes);
+  // Get the position to dump each thread's tasks back into the
+  // vector from the partition sizes of all of the threads.
+  splinter.prefixOffsets(sizes, offsets, backend, numThreads);
+  
+  // Refill the input vector with the partitioned values.  
+  backend.parallelFor(numThreads, numThreads, [&](int threadID) {
+    for (int i = 0; i < numTasks; ++i) {
+      partitions[threadID]->popTask(offsets[threadID][i]);
+    }
+    partitions[threadID].reset();
+  });
 
-  // Register each thread's partition sizes with Splinter
-  for (int i = 0; i < numThreads; ++i) {
-    if (i == threadID) {
-      splinter.addSizes(mySizes);
+  // The first thread's offsets define the beginning of the partition.
+  taskOffsets.swap(offsets[0]);
+}
+
+template <class type>
+void SorterThreaded<type>::sortSerial(typename std::vector<type>::iterator begin,
+                                      typename std::vector<type>::iterator end,
+                                      SorterThreadedHelper::SortProgress<type>* progress) {
+  if (progress != NULL) {
+    progress->setTasks(std::vector<typename std::vector<type>::iterator>(1, begin), end);
+  }
+  SorterThreadedHelper::prefixSort<type>(begin, end);
+  if (progress != NULL) {
+    progress->taskDone(0);
+  }
+}
+
+template <class type>
+void SorterThreaded<type>::insert(std::vector<type>& sorted,
+                                  typename std::vector<type>::iterator batchBegin,
+                                  typename std::vector<type>::iterator batchEnd) {
+  size_t numBatch = std::distance(batchBegin, batchEnd);
+  if (numBatch == 0) {
+    return;
+  }
+  // A batch inside sorted would be invalidated by the resize below.
+  // The only such batch allowed is one appended to the end, which is
+  // copied out before it is merged.
+  std::less<const type*> before;
+  const type* batchData = &*batchBegin;
+  const type* sortedEnd = sorted.data() + sorted.size();
+  if (!sorted.empty() && !before(batchData, sorted.data()) && before(batchData, sortedEnd)) {
+    if (batchData + numBatch != sortedEnd) {
+      throw SorterThreadedException(SorterThreadedException::InsertAliased);
     }
-#pragma omp barrier
+    sort(batchBegin, batchEnd);
+    std::vector<type> batch(batchBegin, batchEnd);
+    SorterThreadedHelper::mergeInPlace<type>(sorted, sorted.size() - numBatch,
+                                             batch.begin(), batch.end(),
+                                             backend(), numThreads());
+    return;
   }
 
-  // Get the position to dump each thread's tasks back into the
-  // vector.
-  std::vector<typename std::vector<type>::iterator> offsets;
+  sort(batchBegin, batchEnd);
+  size_t numSorted = sorted.size();
+  sorted.resize(numSorted + numBatch);
+  SorterThreadedHelper::mergeInPlace<type>(sorted, numSorted, batchBegin, batchEnd,
+                                           backend(), numThreads());
+}
+
+template <class type>
+template <class hasher>
+void SorterThreaded<type>::groupBy(typename std::vector<type>::iterator begin,
+                                   typename std::vector<type>::iterator end,
+                                   std::vector<typename std::vector<type>::iterator>& groups,
+                                   const hasher& hash) {
+  int numThreads = this->numThreads();
+  size_t numEl = std::distance(begin, end);
+  size_t numTasks = static_cast<size_t>(numThreads) * taskFactor_;
+  if (numThreads == 1) {
+    numTasks = 1;
+  }
+  // Even on one thread, split the range so that each task's hash
+  // table stays in cache; a table that does not fit makes every
+  // lookup a cache miss.
+  if (numTasks < numEl / groupTaskSize_) {
+    numTasks = numEl / groupTaskSize_;
+  }
+  if (numTasks > numEl / minTaskSize_) {
+    numTasks = numEl / minTaskSize_;
+  }
+
+  std::vector<typename std::vector<type>::iterator> taskOffsets(1, begin);
+  if (numTasks >= 2) {
+    scatter(begin, end, SorterThreadedHelper::HashPartition<type, hasher>(numTasks, hash),
+            taskOffsets);
+  }
+  int numGroupTasks = taskOffsets.size();
+
+  // Group each task with a hash table of its own.
+  std::vector<std::vector<typename std::vector<type>::iterator> > taskGroups(numGroupTasks);
+  backend().parallelFor(numGroupTasks, numThreads, [&](int i) {
+    typename std::vector<type>::iterator taskEnd = i != numGroupTasks - 1 ? taskOffsets[i+1] : end;
+    SorterThreadedHelper::groupRange<type, hasher>(taskOffsets[i], taskEnd, hash, taskGroups[i]);
+  });
+
+  groups.clear();
+  for (int i = 0; i < numGroupTasks; ++i) {
+    groups.insert(groups.end(), taskGroups[i].begin(), taskGroups[i].end());
+  }
+}
+
+template <class type>
+size_t SorterThreaded<type>::quantiles(typename std::vector<type>::iterator begin,
+                                       typename std::vector<type>::iterator end,
+                                       const std::vector<double>& probs,
+                                       std::vector<type>& values,
+                                       bool exact, size_t numBuckets) {
+  ThreadBackend& backend = this->backend();
+  int numThreads = this->numThreads();
+  size_t numEl = std::distance(begin, end);
+  for (size_t q = 0; q < probs.size(); ++q) {
+    if (probs[q] != probs[q]) {
+      throw SorterThreadedException(SorterThreadedException::QuantileNaN);
+    }
+  }
+  values.clear();
+  if (numEl == 0) {
+    return 0;
+  }
+  std::vector<size_t> ranks(probs.size());
+  for (size_t q = 0; q < probs.size(); ++q) {
+    double prob = std::min(std::max(probs[q], 0.0), 1.0);
+    ranks[q] = static_cast<size_t>(prob * (numEl - 1) + 0.5);
+  }
+
+  // The sample can miss values, so no pivots does not mean only one
+  // value; the whole range is then a single bucket.  Bucket i holds
+  // the values not less than lowers[i-1] and less than lowers[i], and
+  // the classifier finds it with the same search as Partition.
+  std::set<type> pivots;
+  if (numBuckets > 1) {
+    samplePivots(begin, end, numBuckets - 1, pivots);
+  }
+  SorterThreadedHelper::PivotClassifier<type> classifier(pivots);
+  const std::vector<type>& lowers = classifier.pivots();
+  size_t numTasks = classifier.numTasks();
+
+  // Count each thread's chunk and find its smallest and largest
+  // values.  The smallest is the lower bound of the first bucket.
+  SorterThreadedHelper::Splinter<type> splinter(begin, end, numTasks);
+  std::vector<typename std::vector<type>::iterator> chunks;
+  splinter.even(numThreads, chunks);
+  std::vector<std::vector<size_t> > sizes(numThreads, std::vector<size_t>(numTasks, 0));
+  std::vector<std::pair<typename std::vector<type>::iterator,
+                        typename std::vector<type>::iterator> > extremes(numThreads);
+  backend.parallelFor(numThreads, numThreads, [&](int threadID) {
+    if (!lowers.empty()) {
+      classifier.count(chunks[threadID], chunks[threadID+1], sizes[threadID]);
+    }
+    extremes[threadID] = std::minmax_element(chunks[threadID], chunks[threadID+1]);
+  });
+  type minimum = *begin;
+  type maximum = *begin;
   for (int i = 0; i < numThreads; ++i) {
-    if (i == threadID) {
-      splinter.getOffsets(mySizes, offsets);
+    if (chunks[i] != chunks[i+1]) {
+      if (*extremes[i].first < minimum) minimum = *extremes[i].first;
+      if (maximum < *extremes[i].second) maximum = *extremes[i].second;
     }
-#pragma omp barrier
   }
-  
-  // Refill the input vector with the partitioned values.  
-  for (int i = 0; i < numTasks; ++i) {
-    partition.popTask(offsets[i]);
+  if (!(minimum < maximum)) {
+    values.assign(probs.size(), minimum);
+    return 0;
   }
 
-  // The last thread's offsets define the beginning of the partition so
-  // copy them into the shared vector taskOffsets().
-  if (threadID == numThreads - 1) {
-    std::copy(offsets.begin(), offsets.end(), taskOffsets.begin());
+  // The rank of each bucket's smallest value is the number of values
+  // in the buckets before it.
+  std::vector<size_t> bucketRanks(numTasks + 1, numEl);
+  size_t total = 0;
+  for (size_t i = 0; i < numTasks; ++i) {
+    bucketRanks[i] = total;
+    for (int t = 0; t < numThreads; ++t) {
+      total += sizes[t][i];
+    }
   }
+  std::vector<size_t> buckets(probs.size());
+  for (size_t q = 0; q < probs.size(); ++q) {
+    buckets[q] = std::upper_bound(bucketRanks.begin(), bucketRanks.end(), ranks[q]) -
+                 bucketRanks.begin() - 1;
+  }
+
+  if (!exact) {
+    // Each bucket's smallest value is its lower pivot, and it sits at
+    // the bucket's rank.
+    size_t bound = 0;
+    values.resize(probs.size());
+    for (size_t q = 0; q < probs.size(); ++q) {
+      values[q] = buckets[q] == 0 ? minimum : lowers[buckets[q] - 1];
+      bound = std::max(bound, ranks[q] - bucketRanks[buckets[q]]);
+    }
+    return bound;
+  }
+
+  // Pull the values of the buckets we need out of each chunk, then
+  // select the requested ranks within each of those buckets.
+  std::vector<int> needed(numTasks, -1);
+  std::vector<size_t> neededBuckets;
+  for (size_t q = 0; q < probs.size(); ++q) {
+    if (needed[buckets[q]] == -1) {
+      needed[buckets[q]] = neededBuckets.size();
+      neededBuckets.push_back(buckets[q]);
+    }
+  }
+  int numNeeded = neededBuckets.size();
+  std::vector<std::vector<std::vector<type> > > pulled(numThreads,
+      std::vector<std::vector<type> >(numNeeded));
+  backend.parallelFor(numThreads, numThreads, [&](int threadID) {
+    for (typename std::vector<type>::iterator it = chunks[threadID];
+         it != chunks[threadID+1]; ++it) {
+      int n = needed[classifier.task(*it)];
+      if (n != -1) {
+        pulled[threadID][n].push_back(*it);
+      }
+    }
+  });
+  std::vector<std::vector<type> > bucketValues(numNeeded);
+  backend.parallelFor(numNeeded, numThreads, [&](int n) {
+    for (int i = 0; i < numThreads; ++i) {
+      bucketValues[n].insert(bucketValues[n].end(), pulled[i][n].begin(), pulled[i][n].end());
+      std::vector<type>().swap(pulled[i][n]);
+    }
+    // Select the ranks wanted from this bucket in increasing order,
+    // each one from what is left above the one before.
+    std::vector<size_t> local;
+    for (size_t q = 0; q < probs.size(); ++q) {
+      if (buckets[q] == neededBuckets[n]) {
+        local.push_back(ranks[q] - bucketRanks[buckets[q]]);
+      }
+    }
+    std::sort(local.begin(), local.end());
+    typename std::vector<type>::iterator first = bucketValues[n].begin();
+    for (size_t j = 0; j < local.size(); ++j) {
+      typename std::vector<type>::iterator nth = bucketValues[n].begin() + local[j];
+      if (nth >= first) {
+        std::nth_element(first, nth, bucketValues[n].end());
+        first = nth + 1;
+      }
+    }
+  });
+  values.resize(probs.size());
+  for (size_t q = 0; q < probs.size(); ++q) {
+    values[q] = bucketValues[needed[buckets[q]]][ranks[q] - bucketRanks[buckets[q]]];
+  }
+  return 0;
 }
 
-  // This parallel region is for sorting the partitioned intervals.  
-#pragma omp parallel for schedule (dynamic) num_threads(numThreads) default(shared)
-  for (int i = 0; i < numTasks; ++i) {
-    if (i != numTasks - 1) {
-#ifdef STL_SORT_THREAD_SAFE
-      std::sort(taskOffsets[i], taskOffsets[i+1]);
-#else
-      SorterThreadedHelper::quick_sort<type>(taskOffsets[i], taskOffsets[i+1]);
-#endif
+template <class type>
+SortHandle<type> SorterThreaded<type>::sortAsync(typename std::vector<type>::iterator begin,
+                                                 typename std::vector<type>::iterator end,
+                                                 const std::function<void()>& callback) {
+  // The background thread works on a copy of this sorter so that the
+  // settings can be changed while it runs.  The SortProgress owns the
+  // thread and joins it when the last handle goes away.  The callback
+  // is destroyed on the background thread once it exits, and if it
+  // held the last handle the thread is detached rather than joined.
+  std::shared_ptr<SorterThreadedHelper::SortProgress<type> > 
+    progress(new SorterThreadedHelper::SortProgress<type>);
+  SorterThreadedHelper::SortProgress<type>* state = progress.get();
+  SorterThreaded<type> sorter(*this);
+  state->start([sorter, begin, end, state, callback]() mutable {
+    try {
+      sorter.sort(begin, end, state);
     }
-    else {
-#ifdef STL_SORT_THREAD_SAFE
-      std::sort(taskOffsets[numTasks - 1], end);
-#else
-      SorterThreadedHelper::quick_sort<type>(taskOffsets[numTasks - 1], end);
-#endif
+    catch (...) {
+      state->fail(std::current_exception());
+    }
+    // The callback runs before finish() so that it has returned by the
+    // time wait() or done() report the sort complete.  An exception
+    // from it is rethrown by wait() like one from the sort.
+    if (callback) {
+      try {
+        callback();
+      }
+      catch (...) {
+        state->fail(std::current_exception());
+      }
+    }
+    state->finish();
+  });
+  return SortHandle<type>(progress);
+}
+
+template <class type>
+template <class... payload_iterators>
+void SorterThreaded<type>::sortByKey(typename std::vector<type>::iterator keyBegin,
+                                     typename std::vector<type>::iterator keyEnd,
+                                     payload_iterators... payloadBegins) {
+  // Pair each key with its position and sort the pairs with the same
+  // engine as sort().  The payload columns are never touched by the
+  // partition step, they are reordered once the permutation is known.
+  int numThreads = this->numThreads();
+  size_t n = std::distance(keyBegin, keyEnd);
+  std::vector<SorterThreadedHelper::KeyIndex<type> > keyed(n);
+  parallelRange(backend(), n, numThreads, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      keyed[i] = SorterThreadedHelper::KeyIndex<type>(keyBegin[i], i);
     }
+  });
+
+  SorterThreaded<SorterThreadedHelper::KeyIndex<type> > keySorter(taskFactor_, maxThreads_);
+  keySorter.setBackend(backend_);
+  keySorter.sort(keyed.begin(), keyed.end());
+
+  std::vector<size_t> perm(n);
+  parallelRange(backend(), n, numThreads, [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      keyBegin[i] = std::move(keyed[i].key);
+      perm[i] = keyed[i].index;
+    }
+  });
+  // Each column is permuted in place on its own thread.
+  std::vector<std::function<void()> > columns;
+  permutePayloads(perm, columns, payloadBegins...);
+  backend().parallelFor(static_cast<int>(columns.size()), numThreads, [&](int c) {
+    columns[c]();
+  });
+}
+
+template <class type>
+void SorterThreaded<type>::permutePayloads(const std::vector<size_t>& perm,
+                                           std::vector<std::function<void()> >& columns) {
+  // Ends the recursion over the payload columns.
+}
+
+template <class type>
+template <class payload_iterator, class... payload_iterators>
+void SorterThreaded<type>::permutePayloads(const std::vector<size_t>& perm,
+                                           std::vector<std::function<void()> >& columns,
+                                           payload_iterator payloadBegin,
+                                           payload_iterators... payloadBegins) {
+  columns.push_back([&perm, payloadBegin]() {
+    SorterThreadedHelper::permute(perm, payloadBegin);
+  });
+  permutePayloads(perm, columns, payloadBegins...);
+}
+
+template <class type>
+ThreadBackend& SorterThreaded<type>::backend() {
+  return backend_ != NULL ? *backend_ : defaultBackend();
+}
+
+template <class type>
+int SorterThreaded<type>::numThreads() {
+  // Get the number of threads and reset it if the attribute
+  // maxThreads_ is smaller
+  int numThreads = backend().maxThreads();
+  if (maxThreads_ != -1 && maxThreads_ < numThreads) {
+    numThreads = maxThreads_;
   }
-#endif //end of #ifdef _OPENMP
+  return numThreads;
 }
 
 template <class type>
 SorterThreaded<type>::SorterThreaded(int taskFactor, int maxThreads) :
   taskFactor_(taskFactor), 
-  maxThreads_(maxThreads) {}
+  maxThreads_(maxThreads),
+  maxFanOut_(64),
+  minTaskSize_(1024),
+  groupTaskSize_(65536),
+  backend_(NULL) {}
 
 template <class type>
 void SorterThreaded<type>::setMaxThreads(int maxThreads) {
@@ -194,4 +734,14 @@ void SorterThreaded<type>::setTaskFactor(int taskFactor) {
   taskFactor_ = taskFactor;
 }
 
+template <class type>
+void SorterThreaded<type>::setMaxFanOut(int maxFanOut) {
+  maxFanOut_ = maxFanOut < 2 ? 2 : maxFanOut;
+}
+
+template <class type>
+void SorterThreaded<type>::setBackend(ThreadBackend* backend) {
+  backend_ = backend;
+}
+
 #endif
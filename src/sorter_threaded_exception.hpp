@@ -8,7 +8,11 @@
 
 struct SorterThreadedException : std::exception {
   enum Error {SplinterOrder = 1,
-              SplinterSize = 2};
+              SplinterSize = 2,
+              TransportIO = 3,
+              TransportRank = 4,
+              InsertAliased = 5,
+              QuantileNaN = 6};
   inline SorterThreadedException(Error code) : error(code) {} 
   const Error error;
 };
@@ -7,8 +7,30 @@
 
 #include "sorter_threaded.hpp"
 #include <algorithm>
+#include <string>
+#include <sstream>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+#include <chrono>
+#include <stdexcept>
+#include <future>
+#include <memory>
 #include <assert.h>
 
+// Signals when it is destroyed.
+struct Notifier {
+  Notifier(const std::shared_ptr<std::promise<void> >& promise) : promise_(promise) {}
+  ~Notifier() { promise_->set_value(); }
+  std::shared_ptr<std::promise<void> > promise_;
+};
+
+// Holds a SortHandle, and signals once the handle has been destroyed.
+struct HandleSlot {
+  HandleSlot(const std::shared_ptr<std::promise<void> >& promise) : notifier(promise) {}
+  Notifier notifier;
+  std::unique_ptr<SortHandle<double> > handle;
+};
 
 int main(int argc, char **argv) {
   size_t testSize = 1000000;
@@ -26,4 +48,300 @@ int main(int argc, char **argv) {
 
   assert(testVector == orderedVector);
 
+  // Sort a key column with two payload columns.  Every key is
+  // repeated so that stability can be checked with the first payload.
+  std::vector<double> keys(testSize);
+  std::vector<size_t> order(testSize);
+  std::vector<std::string> names(testSize);
+  for (size_t i = 0; i < testSize; i++) {
+    keys[i] = static_cast<double>(i / 2);
+  }
+  random_shuffle(keys.begin(), keys.end());
+  for (size_t i = 0; i < testSize; i++) {
+    order[i] = i;
+    std::ostringstream name;
+    name << keys[i];
+    names[i] = name.str();
+  }
+
+  st.sortByKey(keys.begin(), keys.end(), order.begin(), names.begin());
+
+  for (size_t i = 0; i < testSize; i++) {
+    assert(keys[i] == static_cast<double>(i / 2));
+    std::ostringstream name;
+    name << keys[i];
+    assert(names[i] == name.str());
+    if (i % 2 == 1) {
+      assert(order[i - 1] < order[i]);
+    }
+  }
+
+  // Sort in the background and consume the tasks as they finish.
+  random_shuffle(testVector.begin(), testVector.end());
+  bool called = false;
+  SortHandle<double> handle = st.sortAsync(testVector.begin(), testVector.end(),
+                                           [&called]() { called = true; });
+  std::vector<double>::iterator taskBegin, taskEnd;
+  std::vector<double>::iterator expected = testVector.begin();
+  while (handle.next(taskBegin, taskEnd)) {
+    assert(taskBegin == expected);
+    assert(std::is_sorted(taskBegin, taskEnd));
+    if (taskBegin != testVector.begin() && taskBegin != taskEnd) {
+      assert(!(*taskBegin < *(taskBegin - 1)));
+    }
+    expected = taskEnd;
+  }
+  assert(expected == testVector.end());
+  handle.wait();
+  // The callback has returned by the time wait() does, even if it is
+  // slow.
+  assert(called);
+  assert(handle.done());
+  assert(testVector == orderedVector);
+  random_shuffle(testVector.begin(), testVector.end());
+  called = false;
+  handle = st.sortAsync(testVector.begin(), testVector.end(), [&called]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    called = true;
+  });
+  handle.wait();
+  assert(called);
+  assert(testVector == orderedVector);
+
+  // An exception from the callback is rethrown by wait().
+  random_shuffle(testVector.begin(), testVector.end());
+  handle = st.sortAsync(testVector.begin(), testVector.end(), []() {
+    throw std::runtime_error("callback failed");
+  });
+  bool threw = false;
+  try {
+    handle.wait();
+  }
+  catch (std::runtime_error&) {
+    threw = true;
+  }
+  assert(threw);
+  assert(testVector == orderedVector);
+
+  // The callback can hold the last handle, which is then released on
+  // the background thread itself.
+  {
+    std::promise<void> released;
+    std::shared_future<void> releasedFuture(released.get_future());
+    std::shared_ptr<std::promise<void> > destroyed(new std::promise<void>);
+    std::future<void> destroyedFuture(destroyed->get_future());
+    std::shared_ptr<HandleSlot> slot(new HandleSlot(destroyed));
+    random_shuffle(testVector.begin(), testVector.end());
+    SortHandle<double> last = st.sortAsync(testVector.begin(), testVector.end(),
+                                           [slot, releasedFuture]() { releasedFuture.wait(); });
+    slot->handle.reset(new SortHandle<double>(last));
+    last = handle;
+    slot.reset();
+    released.set_value();
+    destroyedFuture.wait();
+    assert(testVector == orderedVector);
+  }
+
+  // Sort on a std::thread pool instead of the default backend.
+  ThreadPoolBackend pool(4);
+  st.setBackend(&pool);
+  random_shuffle(testVector.begin(), testVector.end());
+  st.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+  st.setBackend(NULL);
+
+  // Force three levels of partitioning with a small fan-out.
+  SorterThreaded<double> multiLevel(8, 4);
+  multiLevel.setMaxFanOut(4);
+  multiLevel.setBackend(&pool);
+  random_shuffle(testVector.begin(), testVector.end());
+  multiLevel.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+
+  // A fan-out below 2 is raised to 2, and three levels of 2 are too
+  // few for 64 tasks, so the cap is exceeded rather than failing.
+  SorterThreaded<double> narrow(16, 4);
+  narrow.setMaxFanOut(0);
+  narrow.setBackend(&pool);
+  random_shuffle(testVector.begin(), testVector.end());
+  narrow.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+
+  // Already sorted, reversed, and only a few distinct values.
+  multiLevel.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+  std::reverse(testVector.begin(), testVector.end());
+  multiLevel.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+  for (size_t i = 0; i < testSize; i++) {
+    testVector[i] = static_cast<double>(i % 5);
+  }
+  std::vector<double> fewValues(testVector);
+  std::sort(fewValues.begin(), fewValues.end());
+  multiLevel.sort(testVector.begin(), testVector.end());
+  assert(testVector == fewValues);
+
+  // Insert the odd values into a vector of the even ones.
+  std::vector<double> evens;
+  std::vector<double> odds;
+  for (size_t i = 0; i < testSize; i++) {
+    if (i % 2 == 0) {
+      evens.push_back(orderedVector[i]);
+    }
+    else {
+      odds.push_back(orderedVector[i]);
+    }
+  }
+  random_shuffle(odds.begin(), odds.end());
+  multiLevel.insert(evens, odds.begin(), odds.end());
+  assert(evens == orderedVector);
+
+  // Append a batch to the sorted vector and insert it from there.
+  std::vector<double> appended(orderedVector.begin(), orderedVector.begin() + testSize / 2);
+  appended.insert(appended.end(), orderedVector.begin() + testSize / 2, orderedVector.end());
+  random_shuffle(appended.begin() + testSize / 4, appended.end());
+  multiLevel.insert(appended, appended.begin() + testSize / 4, appended.end());
+  assert(appended == orderedVector);
+  // A batch in the middle of the sorted vector is rejected.
+  bool aliased = false;
+  try {
+    multiLevel.insert(appended, appended.begin() + 10, appended.begin() + 20);
+  }
+  catch (SorterThreadedException& e) {
+    aliased = e.error == SorterThreadedException::InsertAliased;
+  }
+  assert(aliased);
+
+  // Group 1000 distinct values.
+  std::vector<int> groupVector(testSize);
+  for (size_t i = 0; i < testSize; i++) {
+    groupVector[i] = static_cast<int>(i % 1000) * 7919;
+  }
+  random_shuffle(groupVector.begin(), groupVector.end());
+  SorterThreaded<int> grouper;
+  std::vector<std::vector<int>::iterator> groups;
+  grouper.groupBy(groupVector.begin(), groupVector.end(), groups);
+  assert(groups.size() == 1000);
+  std::set<int> seen;
+  for (size_t g = 0; g < groups.size(); g++) {
+    std::vector<int>::iterator groupEnd = g != groups.size() - 1 ? groups[g+1] : groupVector.end();
+    assert(std::distance(groups[g], groupEnd) == static_cast<long>(testSize / 1000));
+    assert(std::count(groups[g], groupEnd, *groups[g]) == groupEnd - groups[g]);
+    assert(seen.insert(*groups[g]).second);
+  }
+
+  // Quantiles of 0, 1, ..., testSize - 1 are their own ranks.
+  testVector = orderedVector;
+  random_shuffle(testVector.begin(), testVector.end());
+  std::vector<double> unsorted(testVector);
+  std::vector<double> probs;
+  probs.push_back(0.0);
+  probs.push_back(0.5);
+  probs.push_back(0.99);
+  probs.push_back(0.999);
+  probs.push_back(1.0);
+  std::vector<double> quantiles;
+  size_t bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles);
+  assert(testVector == unsorted);
+  assert(quantiles.size() == probs.size());
+  assert(bound < testSize / 100);
+  for (size_t q = 0; q < probs.size(); q++) {
+    double rank = std::floor(probs[q] * (testSize - 1) + 0.5);
+    assert(quantiles[q] <= rank && rank - quantiles[q] <= bound);
+  }
+  bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles, true);
+  assert(bound == 0);
+  for (size_t q = 0; q < probs.size(); q++) {
+    assert(quantiles[q] == std::floor(probs[q] * (testSize - 1) + 0.5));
+  }
+  // Few distinct values, checked against a full sort.
+  for (size_t i = 0; i < testSize; i++) {
+    testVector[i] = static_cast<double>(rand() % 7);
+  }
+  std::vector<double> reference(testVector);
+  std::sort(reference.begin(), reference.end());
+  st.quantiles(testVector.begin(), testVector.end(), probs, quantiles, true);
+  for (size_t q = 0; q < probs.size(); q++) {
+    assert(quantiles[q] == reference[static_cast<size_t>(probs[q] * (testSize - 1) + 0.5)]);
+  }
+
+  // A single bucket: exact results are still exact, and estimates are
+  // the minimum with the rank as the bound.
+  testVector = unsorted;
+  bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles, true, 1);
+  assert(bound == 0);
+  for (size_t q = 0; q < probs.size(); q++) {
+    assert(quantiles[q] == std::floor(probs[q] * (testSize - 1) + 0.5));
+  }
+  bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles, false, 1);
+  assert(bound == testSize - 1);
+  for (size_t q = 0; q < probs.size(); q++) {
+    assert(quantiles[q] == 0);
+  }
+
+  // Only the sampled positions hold zero, so the sample sees a single
+  // value while the vector holds many.
+  size_t numSamples = 1023 * 4 + 3;
+  for (size_t i = 0; i < numSamples; i++) {
+    testVector[i * testSize / numSamples] = 0;
+  }
+  reference = testVector;
+  std::sort(reference.begin(), reference.end());
+  bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles, true);
+  assert(bound == 0);
+  for (size_t q = 0; q < probs.size(); q++) {
+    assert(quantiles[q] == reference[static_cast<size_t>(probs[q] * (testSize - 1) + 0.5)]);
+  }
+  bound = st.quantiles(testVector.begin(), testVector.end(), probs, quantiles);
+  for (size_t q = 0; q < probs.size(); q++) {
+    size_t rank = static_cast<size_t>(probs[q] * (testSize - 1) + 0.5);
+    assert(quantiles[q] == 0 && rank <= bound);
+  }
+
+  // A NaN fraction is rejected.
+  probs.push_back(std::nan(""));
+  bool rejected = false;
+  try {
+    st.quantiles(testVector.begin(), testVector.end(), probs, quantiles);
+  }
+  catch (SorterThreadedException& e) {
+    rejected = e.error == SorterThreadedException::QuantileNaN;
+  }
+  assert(rejected);
+
+  // Strings use their KeyPrefix.  Half of them share the first eight
+  // bytes, so the prefixes tie and operator< decides.
+  size_t numStrings = 200000;
+  std::vector<std::string> strings(numStrings);
+  for (size_t i = 0; i < numStrings; i++) {
+    std::ostringstream name;
+    name << (i % 2 ? "samekey_" : "") << rand();
+    strings[i] = name.str();
+  }
+  std::vector<std::string> sortedStrings(strings);
+  std::sort(sortedStrings.begin(), sortedStrings.end());
+  SorterThreaded<std::string> stringSorter;
+  stringSorter.sort(strings.begin(), strings.end());
+  assert(strings == sortedStrings);
+
+  // sortByKey() with string keys goes through their KeyPrefix too,
+  // and stays stable when keys tie on their prefix and in full.
+  std::vector<std::string> stringKeys(numStrings);
+  std::vector<size_t> stringOrder(numStrings);
+  for (size_t i = 0; i < numStrings; i++) {
+    std::ostringstream name;
+    name << (i % 2 ? "samekey_" : "") << rand() % 50000;
+    stringKeys[i] = name.str();
+    stringOrder[i] = i;
+  }
+  std::vector<std::pair<std::string, size_t> > expectedPairs(numStrings);
+  for (size_t i = 0; i < numStrings; i++) {
+    expectedPairs[i] = std::make_pair(stringKeys[i], i);
+  }
+  std::sort(expectedPairs.begin(), expectedPairs.end());
+  stringSorter.sortByKey(stringKeys.begin(), stringKeys.end(), stringOrder.begin());
+  for (size_t i = 0; i < numStrings; i++) {
+    assert(stringKeys[i] == expectedPairs[i].first);
+    assert(stringOrder[i] == expectedPairs[i].second);
+  }
 }
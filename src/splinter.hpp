@@ -3,15 +3,19 @@
 // Breaks up a vector into pieces for threaded sorting.  The even()
 // method breaks the interval into equal size pieces.  The addSizes()
 // and getOffsets() methods are used together to break up the interval
-// into the partitioned pieces.  
+// into the partitioned pieces.  The prefixOffsets() method does the
+// work of both for all of the threads at once, so the threads do not
+// have to take turns.
 //
 // C.M. Cantalupo 2011
 // cmcantalupo@gmail.com
 
 #ifndef splinter_hpp
 #define splinter_hpp
+#include <cstddef>
 #include <vector>
 #include "sorter_threaded_exception.hpp"
+#include "thread_backend.hpp"
 
 namespace SorterThreadedHelper {
   template <class type>
@@ -24,6 +28,13 @@ namespace SorterThreadedHelper {
        void addSizes(const std::vector<size_t>& sizes);
        void getOffsets(const std::vector<size_t>& sizes, 
 		       std::vector<typename std::vector<type>::iterator> &chunks);
+       // sizes[t] holds the task sizes of thread t's partition.
+       // offsets[t][i] is set to where thread t's part of task i
+       // goes.  Threads are laid out in order within each task, so
+       // offsets[0] holds the beginning of each task.
+       void prefixOffsets(const std::vector<std::vector<size_t> >& sizes,
+                          std::vector<std::vector<typename std::vector<type>::iterator> >& offsets,
+                          ThreadBackend& backend, int numThreads);
      private:
        bool switchedOff_;
        typename std::vector<type>::iterator begin_;
@@ -94,6 +105,54 @@ namespace SorterThreadedHelper {
     }
   }
   
+  template <class type>
+  void Splinter<type>::prefixOffsets(const std::vector<std::vector<size_t> >& sizes,
+                                     std::vector<std::vector<typename std::vector<type>::iterator> >& offsets,
+                                     ThreadBackend& backend, int numThreads) {
+    size_t numTasks = partitionEnds_.size();
+    size_t numParts = sizes.size();
+    for (size_t t = 0; t < numParts; ++t) {
+      if (sizes[t].size() != numTasks) {
+        throw SorterThreadedException(SorterThreadedException::SplinterSize);
+      }
+    }
+
+    // Total size of each task over the threads, in parallel, then
+    // where each task begins.  There are few tasks, so the scan is
+    // cheaper done serially than with another parallel loop.
+    std::vector<size_t> taskBegins(numTasks);
+    parallelRange(backend, numTasks, numThreads, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        size_t total = 0;
+        for (size_t t = 0; t < numParts; ++t) {
+          total += sizes[t][i];
+        }
+        taskBegins[i] = total;
+      }
+    });
+    size_t total = 0;
+    for (size_t i = 0; i < numTasks; ++i) {
+      size_t size = taskBegins[i];
+      taskBegins[i] = total;
+      total += size;
+    }
+
+    // Within a task each thread's part follows the one before it.
+    offsets.resize(numParts);
+    for (size_t t = 0; t < numParts; ++t) {
+      offsets[t].resize(numTasks);
+    }
+    parallelRange(backend, numTasks, numThreads, [&](size_t first, size_t last) {
+      for (size_t i = first; i < last; ++i) {
+        size_t pos = taskBegins[i];
+        for (size_t t = 0; t < numParts; ++t) {
+          offsets[t][i] = begin_ + pos;
+          pos += sizes[t][i];
+        }
+      }
+    });
+  }
+
   template <class type>
   void Splinter<type>::even(size_t num, std::vector<typename std::vector<type>::iterator>& chunks) {
     chunks.resize(num + 1);
@@ -68,5 +68,31 @@ int main(int argc, char **argv) {
   assert(*(chunks[1]) == 5);
   assert(*(chunks[2]) == 10);
 
+  // All of the threads' offsets at once, thread 0 first in each task.
+  Splinter<double> prefixSp(testVec.begin(), testVec.end(), 3);
+  std::vector<std::vector<size_t> > sizes;
+  sizes.push_back(sizesA);
+  sizes.push_back(sizesB);
+  sizes.push_back(sizesC);
+  sizes.push_back(sizesD);
+  std::vector<std::vector<std::vector<double>::iterator> > offsets;
+  ThreadPoolBackend pool(3);
+  prefixSp.prefixOffsets(sizes, offsets, pool, 3);
+  assert(offsets.size() == 4);
+  assert(*(offsets[0][0]) == 0 && *(offsets[0][1]) == 5 && *(offsets[0][2]) == 10);
+  assert(*(offsets[1][0]) == 1 && *(offsets[1][1]) == 6 && *(offsets[1][2]) == 11);
+  assert(*(offsets[2][0]) == 1 && *(offsets[2][1]) == 7 && *(offsets[2][2]) == 13);
+  assert(*(offsets[3][0]) == 3 && *(offsets[3][1]) == 8 && *(offsets[3][2]) == 13);
+
+  // Sizes for the wrong number of tasks throw a SorterThreadedException.
+  sizes[2].push_back(0);
+  bool threw = false;
+  try {
+    prefixSp.prefixOffsets(sizes, offsets, pool, 3);
+  }
+  catch (SorterThreadedException& e) {
+    threw = e.error == SorterThreadedException::SplinterSize;
+  }
+  assert(threw);
 }
 
@@ -0,0 +1,411 @@
+// ThreadBackend class and its implementations.  SorterThreaded does
+// all of its parallel work through a ThreadBackend so that the sort
+// can run on OpenMP, on its own std::thread pool, or on threads owned
+// by the calling application.
+//
+// The only primitive is parallelFor(), which calls body(i) for every
+// i in [0, num) using up to numThreads threads and returns when all
+// of the calls are done.  Indices are handed out dynamically in
+// increasing order.  The calls for different indices must not depend
+// on each other: there are no barriers, a phase of the sort that
+// needs one is split into two parallelFor() calls.  This is what lets
+// a cooperative executor run the sort without deadlocking, since it
+// never has to run all of the threads at once.
+//
+// OpenMPBackend uses "#pragma omp parallel for schedule(dynamic)" and
+// is the default when compiled with OpenMP.  SerialBackend runs
+// everything on the calling thread and is the default otherwise.
+// ThreadPoolBackend keeps a pool of std::threads, each with its own
+// task queue, and idle threads steal from the queues of busy ones.
+// ExecutorBackend hands work to a function provided by the caller,
+// e.g. one that posts to the application's own thread pool.  In the
+// pool and executor backends the calling thread always works on the
+// loop too, so the loop completes even if no other thread ever picks
+// up its work.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_thread_backend_hpp
+#define st_thread_backend_hpp
+
+#include <cstddef>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+class ThreadBackend {
+  public:
+    virtual ~ThreadBackend() {}
+    // The largest number of threads that parallelFor() can use.
+    virtual int maxThreads() = 0;
+    virtual void parallelFor(int num, int numThreads,
+                             const std::function<void(int)>& body) = 0;
+};
+
+class SerialBackend : public ThreadBackend {
+  public:
+    int maxThreads();
+    void parallelFor(int num, int numThreads,
+                     const std::function<void(int)>& body);
+};
+
+#ifdef _OPENMP
+class OpenMPBackend : public ThreadBackend {
+  public:
+    int maxThreads();
+    void parallelFor(int num, int numThreads,
+                     const std::function<void(int)>& body);
+};
+#endif
+
+class ThreadPoolBackend : public ThreadBackend {
+  public:
+    // numThreads counts the calling thread, so numThreads - 1 worker
+    // threads are started.  The default of -1 uses
+    // std::thread::hardware_concurrency().
+    ThreadPoolBackend(int numThreads = -1);
+    ~ThreadPoolBackend();
+    int maxThreads();
+    void parallelFor(int num, int numThreads,
+                     const std::function<void(int)>& body);
+  private:
+    struct TaskQueue {
+      std::mutex mutex;
+      std::deque<std::function<void()> > tasks;
+    };
+    struct Worker {
+      const ThreadPoolBackend* pool;
+      size_t queue;
+    };
+    ThreadPoolBackend(const ThreadPoolBackend& other);
+    // Identifies the pool and queue of the current thread if it is a
+    // worker.
+    static Worker& currentWorker();
+    // Queue that the current thread pushes to: its own if it is one
+    // of our workers, otherwise the shared queue at the end.
+    size_t localQueue();
+    void push(const std::function<void()>& task);
+    // Runs one task from queue self, or steals one from another queue.
+    bool runOne(size_t self);
+    void work(size_t self);
+    std::vector<std::thread> workers_;
+    std::vector<std::unique_ptr<TaskQueue> > queues_;
+    std::mutex sleepMutex_;
+    std::condition_variable wake_;
+    size_t queued_;
+    bool stop_;
+};
+
+class ExecutorBackend : public ThreadBackend {
+  public:
+    typedef std::function<void(const std::function<void()>&)> Executor;
+    // submit is called with each piece of work to run; concurrency
+    // is the number of threads it can run them on, not counting the
+    // calling thread.
+    ExecutorBackend(const Executor& submit, int concurrency);
+    int maxThreads();
+    void parallelFor(int num, int numThreads,
+                     const std::function<void(int)>& body);
+  private:
+    Executor submit_;
+    int concurrency_;
+};
+
+// The backend used by a SorterThreaded that has not been given one.
+inline ThreadBackend& defaultBackend();
+
+// Splits [0, n) into blocks and calls body(blockBegin, blockEnd) for
+// each of them with parallelFor().
+inline void parallelRange(ThreadBackend& backend, size_t n, int numThreads,
+                          const std::function<void(size_t, size_t)>& body);
+
+namespace SorterThreadedHelper {
+  // A parallelFor() loop shared between the threads working on it.
+  // Any number of threads can call run(), which keeps taking the
+  // next index until there are none left.  wait() returns once every
+  // index is done and rethrows the first exception thrown by body.
+  class DynamicLoop {
+    public:
+      DynamicLoop(int num, const std::function<void(int)>& body);
+      void run();
+      void wait();
+    private:
+      std::atomic<int> next_;
+      int num_;
+      // Only dereferenced while an index is unfinished, so the caller
+      // of parallelFor() is still waiting and body is alive.
+      const std::function<void(int)>* body_;
+      std::mutex mutex_;
+      std::condition_variable finished_;
+      int completed_;
+      std::exception_ptr error_;
+  };
+
+  inline DynamicLoop::DynamicLoop(int num, const std::function<void(int)>& body) :
+    next_(0),
+    num_(num),
+    body_(&body),
+    completed_(0) {}
+
+  inline void DynamicLoop::run() {
+    while (true) {
+      int i = next_++;
+      if (i >= num_) {
+        return;
+      }
+      try {
+        (*body_)(i);
+      }
+      catch (...) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+          error_ = std::current_exception();
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      ++completed_;
+      if (completed_ == num_) {
+        finished_.notify_all();
+      }
+    }
+  }
+
+  inline void DynamicLoop::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (completed_ < num_) {
+      finished_.wait(lock);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+  }
+}
+
+inline int SerialBackend::maxThreads() {
+  return 1;
+}
+
+inline void SerialBackend::parallelFor(int num, int numThreads,
+                                       const std::function<void(int)>& body) {
+  for (int i = 0; i < num; ++i) {
+    body(i);
+  }
+}
+
+#ifdef _OPENMP
+inline int OpenMPBackend::maxThreads() {
+  return omp_get_max_threads();
+}
+
+inline void OpenMPBackend::parallelFor(int num, int numThreads,
+                                       const std::function<void(int)>& body) {
+  // An exception must not leave the parallel region, so keep the
+  // first one and rethrow it after the region.
+  std::exception_ptr error;
+#pragma omp parallel for schedule (dynamic) num_threads(numThreads) default(shared)
+  for (int i = 0; i < num; ++i) {
+    try {
+      body(i);
+    }
+    catch (...) {
+#pragma omp critical (st_openmp_backend_error)
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+#endif
+
+inline ThreadPoolBackend::ThreadPoolBackend(int numThreads) :
+  queued_(0),
+  stop_(false) {
+  if (numThreads < 1) {
+    numThreads = std::thread::hardware_concurrency();
+    if (numThreads < 1) {
+      numThreads = 1;
+    }
+  }
+  // One queue per worker and a shared one for outside callers.
+  for (int i = 0; i < numThreads; ++i) {
+    queues_.push_back(std::unique_ptr<TaskQueue>(new TaskQueue));
+  }
+  for (int i = 0; i < numThreads - 1; ++i) {
+    workers_.push_back(std::thread(&ThreadPoolBackend::work, this, i));
+  }
+}
+
+inline ThreadPoolBackend::~ThreadPoolBackend() {
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    stop_ = true;
+  }
+  wake_.notify_all();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    workers_[i].join();
+  }
+}
+
+inline int ThreadPoolBackend::maxThreads() {
+  return static_cast<int>(workers_.size()) + 1;
+}
+
+inline ThreadPoolBackend::Worker& ThreadPoolBackend::currentWorker() {
+  static thread_local Worker worker = {NULL, 0};
+  return worker;
+}
+
+inline size_t ThreadPoolBackend::localQueue() {
+  Worker& worker = currentWorker();
+  return worker.pool == this ? worker.queue : workers_.size();
+}
+
+inline void ThreadPoolBackend::push(const std::function<void()>& task) {
+  TaskQueue& queue = *queues_[localQueue()];
+  {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    queue.tasks.push_back(task);
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    ++queued_;
+  }
+  wake_.notify_one();
+}
+
+inline bool ThreadPoolBackend::runOne(size_t self) {
+  // The owner takes tasks from the front of its queue, thieves take
+  // them from the back of someone else's.
+  std::function<void()> task;
+  size_t numQueues = queues_.size();
+  for (size_t n = 0; n < numQueues && !task; ++n) {
+    TaskQueue& queue = *queues_[(self + n) % numQueues];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (!queue.tasks.empty()) {
+      if (n == 0) {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      else {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      }
+    }
+  }
+  if (!task) {
+    return false;
+  }
+  {
+    std::lock_guard<std::mutex> lock(sleepMutex_);
+    --queued_;
+  }
+  task();
+  return true;
+}
+
+inline void ThreadPoolBackend::work(size_t self) {
+  currentWorker().pool = this;
+  currentWorker().queue = self;
+  while (true) {
+    if (runOne(self)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleepMutex_);
+    while (!stop_ && queued_ == 0) {
+      wake_.wait(lock);
+    }
+    if (stop_ && queued_ == 0) {
+      return;
+    }
+  }
+}
+
+inline void ThreadPoolBackend::parallelFor(int num, int numThreads,
+                                           const std::function<void(int)>& body) {
+  if (num <= 0) {
+    return;
+  }
+  if (numThreads > maxThreads()) {
+    numThreads = maxThreads();
+  }
+  if (numThreads > num) {
+    numThreads = num;
+  }
+  // Helpers that start after the loop is used up return right away,
+  // so the loop only needs to outlive them through the shared_ptr.
+  std::shared_ptr<SorterThreadedHelper::DynamicLoop>
+    loop(new SorterThreadedHelper::DynamicLoop(num, body));
+  for (int i = 1; i < numThreads; ++i) {
+    push([loop]() { loop->run(); });
+  }
+  loop->run();
+  loop->wait();
+}
+
+inline ExecutorBackend::ExecutorBackend(const Executor& submit, int concurrency) :
+  submit_(submit),
+  concurrency_(concurrency) {}
+
+inline int ExecutorBackend::maxThreads() {
+  return concurrency_ + 1;
+}
+
+inline void ExecutorBackend::parallelFor(int num, int numThreads,
+                                         const std::function<void(int)>& body) {
+  if (num <= 0) {
+    return;
+  }
+  if (numThreads > maxThreads()) {
+    numThreads = maxThreads();
+  }
+  if (numThreads > num) {
+    numThreads = num;
+  }
+  std::shared_ptr<SorterThreadedHelper::DynamicLoop>
+    loop(new SorterThreadedHelper::DynamicLoop(num, body));
+  for (int i = 1; i < numThreads; ++i) {
+    submit_([loop]() { loop->run(); });
+  }
+  loop->run();
+  loop->wait();
+}
+
+inline ThreadBackend& defaultBackend() {
+#ifdef _OPENMP
+  static OpenMPBackend backend;
+#else
+  static SerialBackend backend;
+#endif
+  return backend;
+}
+
+inline void parallelRange(ThreadBackend& backend, size_t n, int numThreads,
+                          const std::function<void(size_t, size_t)>& body) {
+  // A few blocks per thread so that dynamic scheduling can balance
+  // uneven blocks.
+  size_t numBlocks = static_cast<size_t>(numThreads) * 4;
+  if (numBlocks > n) {
+    numBlocks = n;
+  }
+  if (numBlocks == 0) {
+    return;
+  }
+  backend.parallelFor(static_cast<int>(numBlocks), numThreads, [&](int block) {
+    body(n * block / numBlocks, n * (block + 1) / numBlocks);
+  });
+}
+
+#endif
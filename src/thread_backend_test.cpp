@@ -0,0 +1,161 @@
+// Unit test for the ThreadBackend implementations.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#include "thread_backend.hpp"
+#include "sorter_threaded.hpp"
+#include <set>
+#include <deque>
+#include <chrono>
+#include <algorithm>
+#include <assert.h>
+
+// Stands in for an application's own thread pool: work posted to it
+// runs on its threads, not on the thread that posts it.
+class WorkQueue {
+  public:
+    WorkQueue(int numThreads) : stop_(false) {
+      for (int i = 0; i < numThreads; ++i) {
+        threads_.push_back(std::thread(&WorkQueue::drain, this));
+      }
+    }
+    ~WorkQueue() {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+      }
+      ready_.notify_all();
+      for (size_t i = 0; i < threads_.size(); ++i) {
+        threads_[i].join();
+      }
+    }
+    void post(const std::function<void()>& work) {
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        work_.push_back(work);
+      }
+      ready_.notify_one();
+    }
+  private:
+    void drain() {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (true) {
+        while (!stop_ && work_.empty()) {
+          ready_.wait(lock);
+        }
+        if (work_.empty()) {
+          return;
+        }
+        std::function<void()> work(work_.front());
+        work_.pop_front();
+        lock.unlock();
+        work();
+        lock.lock();
+      }
+    }
+    std::mutex mutex_;
+    std::condition_variable ready_;
+    std::deque<std::function<void()> > work_;
+    std::vector<std::thread> threads_;
+    bool stop_;
+};
+
+// Checks that every index is visited exactly once and that an
+// exception thrown by the body comes back out of parallelFor().
+void checkBackend(ThreadBackend& backend) {
+  int num = 1000;
+  std::vector<int> visits(num, 0);
+  backend.parallelFor(num, backend.maxThreads(), [&](int i) {
+    ++visits[i];
+  });
+  for (int i = 0; i < num; ++i) {
+    assert(visits[i] == 1);
+  }
+
+  std::vector<int> blocks(num, 0);
+  parallelRange(backend, num, backend.maxThreads(), [&](size_t first, size_t last) {
+    for (size_t i = first; i < last; ++i) {
+      ++blocks[i];
+    }
+  });
+  for (int i = 0; i < num; ++i) {
+    assert(blocks[i] == 1);
+  }
+
+  bool caught = false;
+  try {
+    backend.parallelFor(num, backend.maxThreads(), [&](int i) {
+      if (i == num / 2) {
+        throw 1;
+      }
+    });
+  }
+  catch (int) {
+    caught = true;
+  }
+  assert(caught);
+}
+
+int main(int argc, char **argv) {
+  SerialBackend serial;
+  assert(serial.maxThreads() == 1);
+  checkBackend(serial);
+  checkBackend(defaultBackend());
+
+  ThreadPoolBackend pool(4);
+  assert(pool.maxThreads() == 4);
+  checkBackend(pool);
+
+  // Nested loops on the pool must not deadlock.
+  std::vector<int> visits(64, 0);
+  pool.parallelFor(8, 4, [&](int i) {
+    pool.parallelFor(8, 4, [&](int j) {
+      ++visits[i * 8 + j];
+    });
+  });
+  for (int i = 0; i < 64; ++i) {
+    assert(visits[i] == 1);
+  }
+
+  // An executor that posts to the application's own threads.  The
+  // loop really is shared with them, and a whole sort runs on them.
+  WorkQueue application(2);
+  ExecutorBackend executor([&application](const std::function<void()>& work) {
+    application.post(work);
+  }, 2);
+  assert(executor.maxThreads() == 3);
+  checkBackend(executor);
+
+  std::mutex idMutex;
+  std::set<std::thread::id> ids;
+  executor.parallelFor(100, 3, [&](int i) {
+    {
+      std::lock_guard<std::mutex> lock(idMutex);
+      ids.insert(std::this_thread::get_id());
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  });
+  assert(ids.size() > 1);
+
+  size_t testSize = 1000000;
+  std::vector<double> testVector(testSize);
+  for (size_t i = 0; i < testSize; ++i) {
+    testVector[i] = static_cast<double>(i);
+  }
+  std::vector<double> orderedVector(testVector);
+  std::random_shuffle(testVector.begin(), testVector.end());
+  SorterThreaded<double> st;
+  st.setBackend(&executor);
+  st.sort(testVector.begin(), testVector.end());
+  assert(testVector == orderedVector);
+
+  // An executor that never runs anything, which the calling thread
+  // must make up for.
+
+  std::vector<std::function<void()> > dropped;
+  ExecutorBackend stalled([&dropped](const std::function<void()>& work) {
+    dropped.push_back(work);
+  }, 3);
+  checkBackend(stalled);
+}
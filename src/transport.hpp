@@ -0,0 +1,134 @@
+// Transport class.  The interface that DistributedSorter uses to move
+// data between the ranks of a multi-process job.  An implementation
+// only has to provide point to point messages through exchange();
+// the collective operations that the sort needs are built on top of
+// it in SorterThreadedHelper.  SocketTransport is the in-tree
+// implementation; an MPI or RDMA implementation can be plugged in by
+// deriving from Transport.
+//
+// C.M. Cantalupo 2011
+// cmcantalupo@gmail.com
+
+#ifndef st_transport_hpp
+#define st_transport_hpp
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include "sorter_threaded_exception.hpp"
+
+class Transport {
+  public:
+    virtual ~Transport() {}
+    // The rank of this process, in [0, size()).
+    virtual int rank() = 0;
+    virtual int size() = 0;
+    // Sends sendBuf to rank dest while receiving the next message from
+    // rank source into recvBuf.  Either side is skipped if its rank is
+    // -1.  Both happen at once so that ranks sending to each other do
+    // not deadlock however large the messages are.  Messages between
+    // any two ranks arrive in the order they were sent.
+    virtual void exchange(int dest, const std::vector<char>& sendBuf,
+                          int source, std::vector<char>& recvBuf) = 0;
+};
+
+namespace SorterThreadedHelper {
+  // Every rank calls these collectively.
+
+  // Rank root receives the buffer of every rank in recvBufs.
+  void gather(Transport& transport, int root,
+              const std::vector<char>& sendBuf,
+              std::vector<std::vector<char> >& recvBufs);
+
+  // buf on rank root is copied to buf on every other rank.
+  void broadcast(Transport& transport, int root, std::vector<char>& buf);
+
+  // sendBufs[r] is sent to rank r and recvBufs[r] is received from
+  // rank r.
+  void allToAll(Transport& transport,
+                const std::vector<std::vector<char> >& sendBufs,
+                std::vector<std::vector<char> >& recvBufs);
+
+  // Converts between vectors of a trivially copyable type and bytes.
+  template <class type>
+  void pack(typename std::vector<type>::const_iterator begin,
+            typename std::vector<type>::const_iterator end,
+            std::vector<char>& buf);
+  template <class type>
+  void unpack(const std::vector<char>& buf, std::vector<type>& values);
+
+  inline void gather(Transport& transport, int root,
+                     const std::vector<char>& sendBuf,
+                     std::vector<std::vector<char> >& recvBufs) {
+    int rank = transport.rank();
+    int size = transport.size();
+    std::vector<char> none;
+    if (rank != root) {
+      transport.exchange(root, sendBuf, -1, none);
+      return;
+    }
+    recvBufs.resize(size);
+    recvBufs[root] = sendBuf;
+    for (int source = 0; source < size; ++source) {
+      if (source != root) {
+        transport.exchange(-1, none, source, recvBufs[source]);
+      }
+    }
+  }
+
+  inline void broadcast(Transport& transport, int root, std::vector<char>& buf) {
+    int rank = transport.rank();
+    int size = transport.size();
+    std::vector<char> none;
+    if (rank != root) {
+      transport.exchange(-1, none, root, buf);
+      return;
+    }
+    for (int dest = 0; dest < size; ++dest) {
+      if (dest != root) {
+        transport.exchange(dest, buf, -1, none);
+      }
+    }
+  }
+
+  inline void allToAll(Transport& transport,
+                       const std::vector<std::vector<char> >& sendBufs,
+                       std::vector<std::vector<char> >& recvBufs) {
+    // In step k every rank sends to the rank k above it and receives
+    // from the rank k below it, so each step is a set of rings.
+    int rank = transport.rank();
+    int size = transport.size();
+    if (static_cast<int>(sendBufs.size()) != size) {
+      throw SorterThreadedException(SorterThreadedException::TransportRank);
+    }
+    recvBufs.resize(size);
+    recvBufs[rank] = sendBufs[rank];
+    for (int k = 1; k < size; ++k) {
+      int dest = (rank + k) % size;
+      int source = (rank - k + size) % size;
+      transport.exchange(dest, sendBufs[dest], source, recvBufs[source]);
+    }
+  }
+
+  template <class type>
+  void pack(typename std::vector<type>::const_iterator begin,
+            typename std::vector<type>::const_iterator end,
+            std::vector<char>& buf) {
+    size_t n = end - begin;
+    buf.resize(n * sizeof(type));
+    if (n != 0) {
+      std::memcpy(&buf[0], &*begin, n * sizeof(type));
+    }
+  }
+
+  template <class type>
+  void unpack(const std::vector<char>& buf, std::vector<type>& values) {
+    size_t n = buf.size() / sizeof(type);
+    values.resize(n);
+    if (n != 0) {
+      std::memcpy(&values[0], &buf[0], n * sizeof(type));
+    }
+  }
+}
+
+#endif